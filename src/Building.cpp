@@ -10,12 +10,22 @@
 #include <stdio.h>
 #include <OpenGL/glu.h>
 
+// Each building's half width along x and y, half its wall height and the
+// height of its roof, then the angle about z in degrees and the offset it
+// is placed at. Draw and Triangles both go by these.
+const int Building::NUM_BUILDINGS = 3;
+const float Building::BUILDINGS[][7] = {
+    { 3, 5, 2, 4, 75, 20, 20 },
+    { 6, 3, 5, 2, 20, -20, 15 },
+    { 4, 10, 7, 3, 30, -20, -30 }
+};
+
 // Destructor
 Building::~Building(void)
 {
     if ( initialized )
     {
-	glDeleteLists(display_list, 3);
+	glDeleteLists(display_list, NUM_BUILDINGS);
 	glDeleteTextures(1, &texture_obj_wall);
 	glDeleteTextures(1, &texture_obj_roof);
     }
@@ -74,19 +84,14 @@ Building::Initialize(void)
     }
 
     // Now do the geometry. Create the display list.
-    display_list = glGenLists(3);
-
-    glNewList(display_list, GL_COMPILE);
-    DrawBuilding(3, 5, 2, 4);
-    glEndList();
+    display_list = glGenLists(NUM_BUILDINGS);
 
-    glNewList(display_list+1, GL_COMPILE);
-    DrawBuilding(6, 3, 5, 2);
-    glEndList();
-
-    glNewList(display_list+2, GL_COMPILE);
-    DrawBuilding(4, 10, 7, 3);
-    glEndList();
+    for(int i = 0; i < NUM_BUILDINGS; i++){
+        const float *b = BUILDINGS[i];
+        glNewList(display_list+i, GL_COMPILE);
+        DrawBuilding(b[0], b[1], b[2], b[3]);
+        glEndList();
+    }
 
     // We only do all this stuff once, when the GL context is first set up.
     initialized = true;
@@ -221,26 +226,46 @@ void Building::DrawWalls(float xsize, float ysize, float zsize)
 void
 Building::Draw(void)
 {
-    glPushMatrix();
-    //Rotation and translation for different buildings
-    glRotatef(75, 0, 0, 1);
-    glTranslatef(20, 20, 0);
-    glCallList(display_list);
-    glPopMatrix();
-
-    glPushMatrix();
-    glRotatef(20, 0, 0, 1);
-    glTranslatef(-20, 15, 0);
-    glCallList(display_list+1);
-    glPopMatrix();
-
-    glPushMatrix();
-    //Rotation and translation for different buildings
-    glRotatef(30, 0, 0, 1);
-    glTranslatef(-20, -30, 0);
-    glCallList(display_list+2);
-    glPopMatrix();
+    for(int i = 0; i < NUM_BUILDINGS; i++){
+        const float *b = BUILDINGS[i];
+        glPushMatrix();
+        //Rotation and translation for different buildings
+        glRotatef(b[4], 0, 0, 1);
+        glTranslatef(b[5], b[6], 0);
+        glCallList(display_list+i);
+        glPopMatrix();
+    }
+}
 
+//The walls as two triangles each, and the roof, moved as Draw moves them
+void Building::Triangles(std::vector<float> & corners){
+    static const float ring[5][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 }, { -1, -1 } };
+
+    corners.clear();
+    for(int i = 0; i < NUM_BUILDINGS; i++){
+        const float *b = BUILDINGS[i];
+        float top = 2 * b[2];
+        float c = cosf(b[4] * M_PI / 180.0);
+        float s = sinf(b[4] * M_PI / 180.0);
+        for(int k = 0; k < 4; k++){
+            float x0 = ring[k][0] * b[0], y0 = ring[k][1] * b[1];
+            float x1 = ring[k+1][0] * b[0], y1 = ring[k+1][1] * b[1];
+            const float side[3][3][3] = {
+                { { x0, y0, 0 }, { x1, y1, 0 }, { x1, y1, top } },
+                { { x0, y0, 0 }, { x1, y1, top }, { x0, y0, top } },
+                { { x0, y0, top }, { x1, y1, top }, { 0, 0, top + b[3] } }
+            };
+            for(int t = 0; t < 3; t++){
+                for(int v = 0; v < 3; v++){
+                    float x = side[t][v][0] + b[5];
+                    float y = side[t][v][1] + b[6];
+                    corners.push_back(c * x - s * y);
+                    corners.push_back(s * x + c * y);
+                    corners.push_back(side[t][v][2]);
+                }
+            }
+        }
+    }
 }
 
 
@@ -9,6 +9,7 @@
 
 #include <Fl/gl.h>
 #include <cmath>
+#include <vector>
 
 class Building {
   private:
@@ -24,6 +25,9 @@ class Building {
     void DrawTriangle(float, float, float, float, float, float, float, float, float, float, float);
     bool LoadTexture(const char* filename, GLuint* textureObj);
 
+    static const int	NUM_BUILDINGS;
+    static const float	BUILDINGS[][7];	// Sizes and placements.
+
   public:
     // Constructor. Can't do initialization here because we are
     // created before the OpenGL context is set up.
@@ -37,6 +41,10 @@ class Building {
 
     // Does the drawing.
     void    Draw(void);
+
+    // The buildings as triangles where they are drawn, nine floats each,
+    // for things that need their shape. Needs no OpenGL context.
+    static void Triangles(std::vector<float> & corners);
 };
 
 
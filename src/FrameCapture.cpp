@@ -0,0 +1,238 @@
+/*
+ * FrameCapture.cpp: A class for recording frames to TGA files.
+ *
+ * Frames are read back into one of two pixel buffer objects. The read
+ * started on one frame is only mapped on the next, by which time the GPU
+ * has finished it, so glReadPixels never waits for the pipeline to drain.
+ * The mapped pixels are copied into a frame that a writer thread encodes
+ * and saves, keeping file I/O off the render loop entirely.
+ */
+
+
+#include "FrameCapture.h"
+#include "libtarga.h"
+#include <stdio.h>
+#include <string.h>
+
+const int FrameCapture::MAX_QUEUED_FRAMES = 8;
+
+
+FrameCapture::FrameCapture(void)
+{
+    pbo[0] = pbo[1] = 0;
+    pbo_width[0] = pbo_width[1] = 0;
+    pbo_height[0] = pbo_height[1] = 0;
+    pbo_index = 0;
+    initialized = false;
+    recording = false;
+    use_rle = true;
+    next_frame = 0;
+    dropped = 0;
+    stopping = false;
+}
+
+
+// Destructor
+FrameCapture::~FrameCapture(void)
+{
+    if ( writer.joinable() )
+    {
+	std::unique_lock<std::mutex> lock(queue_lock);
+	stopping = true;
+	queue_ready.notify_one();
+	lock.unlock();
+	writer.join();
+    }
+
+    for ( size_t i = 0 ; i < free_frames.size() ; i++ )
+	delete free_frames[i];
+
+    if ( initialized )
+	glDeleteBuffers(2, pbo);
+}
+
+
+// Initializer. Creates the two pixel buffers that frames alternate between.
+bool
+FrameCapture::Initialize(void)
+{
+    if ( initialized )
+	return true;
+
+    glGenBuffers(2, pbo);
+
+    initialized = true;
+
+    return true;
+}
+
+
+void
+FrameCapture::Start(const char *file_prefix, bool rle)
+{
+    if ( recording || writer.joinable() )
+	return;
+
+    prefix = file_prefix;
+    use_rle = rle;
+    next_frame = 0;
+    dropped = 0;
+    stopping = false;
+    pbo_width[0] = pbo_width[1] = 0;
+    pbo_height[0] = pbo_height[1] = 0;
+
+    writer = std::thread(&FrameCapture::WriterLoop, this);
+    recording = true;
+}
+
+
+// Stopping can be requested from an event handler, where the GL context may
+// not be current, so the last read-back is collected by the next Capture.
+void
+FrameCapture::Stop(void)
+{
+    recording = false;
+}
+
+
+void
+FrameCapture::Capture(int width, int height)
+{
+    if ( ! initialized || ! writer.joinable() )
+	return;
+
+    if ( ! recording )
+    {
+	// Finish the read started last frame, then let the writer drain.
+	Collect(pbo_index ^ 1);
+
+	std::unique_lock<std::mutex> lock(queue_lock);
+	stopping = true;
+	queue_ready.notify_one();
+	lock.unlock();
+	writer.join();
+
+	fprintf(stderr, "FrameCapture: wrote %d frames, dropped %d\n",
+		next_frame, dropped);
+	return;
+    }
+
+    // Start reading this frame. BGRA is the layout the hardware stores, so
+    // the copy into the buffer needs no conversion.
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[pbo_index]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, 0);
+    pbo_width[pbo_index] = width;
+    pbo_height[pbo_index] = height;
+
+    // Collect the frame whose read was started last time.
+    Collect(pbo_index ^ 1);
+
+    pbo_index ^= 1;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+void
+FrameCapture::Collect(int index)
+{
+    if ( pbo_width[index] == 0 )
+	return;
+
+    int	    width = pbo_width[index];
+    int	    height = pbo_height[index];
+    Frame   *frame;
+
+    pbo_width[index] = pbo_height[index] = 0;
+
+    // If the writer has fallen too far behind, drop this frame rather than
+    // letting the queue, and the memory it holds, grow without bound.
+    std::unique_lock<std::mutex> lock(queue_lock);
+    if ( (int)queue.size() >= MAX_QUEUED_FRAMES )
+    {
+	dropped++;
+	return;
+    }
+    if ( free_frames.empty() )
+	frame = new Frame();
+    else
+    {
+	frame = free_frames.back();
+	free_frames.pop_back();
+    }
+    lock.unlock();
+
+    frame->number = next_frame++;
+    frame->width = width;
+    frame->height = height;
+    frame->pixels.resize(width * height * 4);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[index]);
+    void *data = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if ( data )
+    {
+	memcpy(&frame->pixels[0], data, frame->pixels.size());
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    // Left bound, it would take over every later pixel read in the app.
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    lock.lock();
+    if ( data )
+	queue.push_back(frame);
+    else
+	free_frames.push_back(frame);
+    queue_ready.notify_one();
+}
+
+
+// Runs on the writer thread. Converts each frame to the RGB layout libtarga
+// expects and saves it, until told to stop and the queue is empty.
+void
+FrameCapture::WriterLoop(void)
+{
+    char    filename[1024];
+
+    std::unique_lock<std::mutex> lock(queue_lock);
+    while ( true )
+    {
+	while ( queue.empty() && ! stopping )
+	    queue_ready.wait(lock);
+	if ( queue.empty() )
+	    return;
+
+	Frame *frame = queue.front();
+	queue.pop_front();
+	lock.unlock();
+
+	// BGRA to RGB, in place. Each output pixel is written no further
+	// along than the input pixel it comes from.
+	unsigned char *pixels = &frame->pixels[0];
+	int	    count = frame->width * frame->height;
+	for ( int i = 0 ; i < count ; i++ )
+	{
+	    unsigned char b = pixels[i*4];
+	    unsigned char g = pixels[i*4+1];
+	    unsigned char r = pixels[i*4+2];
+	    pixels[i*3] = r;
+	    pixels[i*3+1] = g;
+	    pixels[i*3+2] = b;
+	}
+
+	// glReadPixels and TGA both start at the bottom row, so no flip.
+	snprintf(filename, sizeof(filename), "%s%05d.tga", prefix.c_str(),
+		 frame->number);
+	int ok = use_rle
+	       ? tga_write_rle(filename, frame->width, frame->height, pixels,
+			       TGA_TRUECOLOR_24)
+	       : tga_write_raw(filename, frame->width, frame->height, pixels,
+			       TGA_TRUECOLOR_24);
+	if ( ! ok )
+	    fprintf(stderr, "FrameCapture: couldn't write %s: %s\n", filename,
+		    tga_error_string(tga_get_last_error()));
+
+	lock.lock();
+	free_frames.push_back(frame);
+    }
+}
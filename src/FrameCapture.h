@@ -0,0 +1,81 @@
+/*
+ * FrameCapture.h: Header file for a class that records rendered frames to
+ * numbered TGA files without stalling the render loop.
+ *
+ */
+
+
+#ifndef _FRAMECAPTURE_H_
+#define _FRAMECAPTURE_H_
+
+#include <Fl/gl.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class FrameCapture {
+  private:
+    // One frame's worth of pixels on its way to the disk.
+    struct Frame {
+        int     number;     // Index used in the file name.
+        int     width;
+        int     height;
+        std::vector<unsigned char> pixels;  // BGRA as read back, bottom row
+                                            // first, until the writer packs
+                                            // it into RGB in place.
+    };
+
+    static const int	MAX_QUEUED_FRAMES;  // Frames allowed to wait for the
+					    // writer before new ones are dropped.
+
+    GLuint  pbo[2];	    // Pixel buffers that frames are read back into.
+    int	    pbo_width[2];   // Size of the frame pending in each buffer, or
+    int	    pbo_height[2];  // 0 if the buffer holds nothing.
+    int	    pbo_index;	    // The buffer the next frame is read into.
+    bool    initialized;    // Whether or not we have been initialized.
+    bool    recording;	    // Whether frames are being captured.
+    bool    use_rle;	    // Write RLE compressed files instead of raw.
+    std::string prefix;	    // File name prefix for the numbered frames.
+    int	    next_frame;	    // Number given to the next captured frame.
+    int	    dropped;	    // Frames dropped because the writer fell behind.
+
+    // Writer thread state. Everything below is guarded by queue_lock.
+    std::thread		    writer;
+    std::mutex		    queue_lock;
+    std::condition_variable queue_ready;
+    std::deque<Frame*>	    queue;	// Frames waiting to be written.
+    std::vector<Frame*>	    free_frames;// Written frames kept for reuse.
+    bool		    stopping;	// Tells the writer to drain and exit.
+
+    void    Collect(int index);	// Hands a finished read-back to the writer.
+    void    WriterLoop(void);
+
+  public:
+    // Constructor. Can't do GL work here because we are created before the
+    // OpenGL context is set up.
+    FrameCapture(void);
+
+    // Destructor. Flushes outstanding frames and frees the pixel buffers.
+    ~FrameCapture(void);
+
+    // Initializer. Creates the pixel buffer objects.
+    bool    Initialize(void);
+
+    // Begin writing frames named <file_prefix>NNNNN.tga.
+    void    Start(const char *file_prefix, bool rle = true);
+
+    // Stop capturing. Waits for queued frames to reach the disk.
+    void    Stop(void);
+
+    bool    Recording(void) { return recording; };
+
+    // Call once per frame after everything is drawn. Starts an asynchronous
+    // read of this frame and collects the one started last frame.
+    void    Capture(int width, int height);
+};
+
+
+#endif
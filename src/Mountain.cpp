@@ -8,274 +8,1044 @@
 #include "Mountain.h"
 #include "libtarga.h"
 #include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
 #include <OpenGL/glu.h>
+#include "MountainRandom.h"
+#include "Parallel.h"
+
+//A budget about the size of level 5, spent where the viewer can see it
+const int Mountain::LOD_MAX_LEVEL = 10;
+const int Mountain::LOD_BUDGET = 4096;
+const float Mountain::LOD_TOLERANCE = 1.5f;
+
+//Level 11 is 8.4 million samples: 34 MB of heights, but 235 MB of vertices
+const int Mountain::GRID_MAX_LEVEL = 11;
+//256 tiles in all, of up to 33,000 samples each at level 11
+const int Mountain::TILE_LEVEL = 3;
+const float Mountain::TILE_TOLERANCE = 1.0f;
+
+//Level 14 is a 2.9 GB file, in 4096 blocks of 132,000 samples
+const int Mountain::BLOCK_MAX_LEVEL = 14;
+const int Mountain::BLOCK_LEVELS = 9;
+
+//Four maps of 1024 texels square, 22 MB with their mipmaps, light 1024
+//triangles of level 4 as finely as level 10's four million
+const int Mountain::NORMAL_MAP_MAX_LEVEL = 10;
+const int Mountain::NORMAL_MAP_COARSE_LEVEL = 4;
+const int Mountain::NORMAL_MAP_UNITS = 3;
+
+//Level 14 would overflow the 32-bit indices
+const int Mountain::MAX_LEVELS = 14;
+//Enough for every level up to 10 along with its buffers
+const size_t Mountain::MAX_PYRAMID_BYTES = (size_t)1 << 30;
+//Levels below this take less time to build than to read
+const int Mountain::CACHE_MIN_LEVEL = 7;
+//Levels 7 to 11 of about nine seeds, or a level 14 block file and more
+const uint64_t Mountain::MAX_CACHE_BYTES = (uint64_t)8 << 30;
 
 // Destructor
 Mountain::~Mountain(void)
 {
+    if ( builder.joinable() )
+    {
+        std::unique_lock<std::mutex> lock(buildLock);
+        stopping = true;
+        buildReady.notify_one();
+        lock.unlock();
+        builder.join();
+    }
+
     if ( initialized )
     {
-        ClearSubdivision();
+        for(size_t l = 0; l < levels.size(); l++){
+            glDeleteBuffers(1, &levels[l].vertexBuffer);
+            glDeleteBuffers(1, &levels[l].indexBuffer);
+        }
+        glDeleteBuffers(1, &lodVertexBuffer);
+        glDeleteBuffers(1, &lodIndexBuffer);
+        for(size_t t = 0; t < tileBuffers.size(); t++){
+            glDeleteBuffers(1, &tileBuffers[t].vertexBuffer);
+            glDeleteBuffers(1, &tileBuffers[t].indexBuffer);
+        }
+        glDeleteTextures(1, &grayTexture);
+        glDeleteTextures((GLsizei)mapTextures.size(), mapTextures.data());
+        glDeleteBuffers(1, &mapVertexBuffer);
+        glDeleteBuffers(1, &mapIndexBuffer);
     }
 }
 
-void Mountain::DrawTriangle(struct triangle* t){
-    float p1x = t->p1->x;
-    float p1y = t->p1->y;
-    float p1z = t->p1->z;
-    float p2x = t->p2->x;
-    float p2y = t->p2->y;
-    float p2z = t->p2->z;
-    float p3x = t->p3->x;
-    float p3y = t->p3->y;
-    float p3z = t->p3->z;
-    
-    //Calculate surface normal
-    float ux = p2x - p1x;
-    float uy = p2y - p1y;
-    float uz = p2z - p1z;
+//Copies a mesh into a vertex and index buffer, returning the index count
+//Called from Draw, where the GL context is current
+GLsizei Mountain::UploadBuffers(const MountainMesh & source, GLuint vertexBuffer,
+                                GLuint indexBuffer){
+    uint32_t numVertices = source.NumVertices();
+    size_t numIndices = source.indices.size();
 
-    float vx = p3x - p1x;
-    float vy = p3y - p1y;
-    float vz = p3z - p1z;
+    //Normals and colors were computed with the level, so this only
+    //interleaves the arrays into the buffer layout. It writes straight
+    //into the mapped buffer, so no staging copy is allocated
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(struct MountainVertex),
+                 NULL, GL_STATIC_DRAW);
+    struct MountainVertex * vertices =
+        (struct MountainVertex *)glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+    if(!vertices){
+        fprintf(stderr, "Mountain: couldn't map the vertex buffer\n");
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return 0;
+    }
+    source.Interleave(vertices);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(uint32_t),
+                 source.indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    float nx = uy*vz - uz*vy;
-    float ny = uz*vx - ux*vz;
-    float nz = ux*vy - uy*vx;
+    return (GLsizei)numIndices;
+}
 
-    glNormal3f(nx, ny, nz);
+//Uploads a level straight from its mapped cache file
+GLsizei Mountain::UploadBuffers(const MountainCache & source, GLuint vertexBuffer,
+                                GLuint indexBuffer){
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, source.NumVertices() * sizeof(struct MountainVertex),
+                 source.Vertices(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    //Color gray
-    glColor3f(0.2+p2z/80, 0.2+p2z/80, 0.2+p2z/80);
-    glVertex3f(p1x, p1y, p1z);
-    glVertex3f(p2x, p2y, p2z);
-    glVertex3f(p3x, p3y, p3z);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, source.NumIndices() * sizeof(uint32_t),
+                 source.Indices(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    return (GLsizei)source.NumIndices();
 }
 
-void Mountain::DrawTriangles(void){
-    glBegin(GL_TRIANGLES);
-    for(std::vector <struct triangle*>::iterator it = triList.begin(); it != triList.end(); ++it){
-        DrawTriangle(*it);
+//Brings the grids to level target, counting every change in gridVersion
+void Mountain::StepGrids(int target){
+    if(grids.empty() || gridSeed != builtSeed){
+        grids.resize(MountainParams::NUM_BASE_TRIANGLES);
+        gridScratch.resize(MountainParams::NUM_BASE_TRIANGLES);
+        for(int i = 0; i < MountainParams::NUM_BASE_TRIANGLES; i++){
+            grids[i].Reset(MountainParams::BASE_TRIANGLES[i]);
+        }
+        gridSeed = builtSeed;
+        gridVersion++;
+    }
+    //A level only adds samples, so going back up just drops them
+    while(grids[0].Level() != target){
+        int l = grids[0].Level();
+        for(int i = 0; i < MountainParams::NUM_BASE_TRIANGLES; i++){
+            if(l < target){
+                gridScratch[i].Subdivide(grids[i], gridSeed, LevelRange(l));
+            }
+            else{
+                gridScratch[i].Coarsen(grids[i]);
+            }
+        }
+        grids.swap(gridScratch);
+        gridVersion++;
     }
-    glEnd();
 }
 
-void Mountain::ClearSubdivision(){
-    edgePtLookup.clear();
-    //Free all triangles
-    for(std::vector <struct triangle*>::iterator it = triList.begin(); it != triList.end(); ++it){
-        delete *it;
-    }
-    triList.clear();
-    //Free all points
-    for(std::vector <struct point*>::iterator it = pointList.begin(); it != pointList.end(); ++it){
-        delete *it;
+//Brings the grids to the level asked for, cutting them into tiles again if
+//that changed them, and refills the buffers of the tiles in view whose
+//detail, or whose neighbors' detail, changed. Levels deeper than the grids
+//go are drawn from their blocks instead, once the builder has written them.
+//Called from Draw, where the GL context is current
+void Mountain::UpdateGrid(const GLfloat modelview[16], const GLfloat projection[16],
+                          const GLint viewport[4]){
+    StepGrids(std::min(targetLevel, GRID_MAX_LEVEL));
+    bool paged = targetLevel > GRID_MAX_LEVEL && blocks.IsOpen() &&
+                 blocks.Key() == CacheKey(targetLevel);
+    uint64_t source = paged ? blocks.Key() : 0;
+    if(tiledVersion != gridVersion || source != tiledKey){
+        if(paged){
+            tiles.Build(blocks);
+        }
+        else{
+            tiles.Build(grids, TILE_LEVEL);
+        }
+        tiledKey = source;
+        tiledVersion = gridVersion;
+        //One step for every tile, so their shared edges pack alike
+        float extent = 0;
+        for(size_t t = 0; t < tiles.NumTiles(); t++){
+            const MountainTile & tile = tiles.Tile(t);
+            for(int k = 0; k < 3 && !tile.empty; k++){
+                extent = std::max(extent, tile.bounds[1][k] - tile.bounds[0][k]);
+            }
+        }
+        tileStep = MountainPacking::Step(extent);
+        for(size_t t = tiles.NumTiles(); t < tileBuffers.size(); t++){
+            glDeleteBuffers(1, &tileBuffers[t].vertexBuffer);
+            glDeleteBuffers(1, &tileBuffers[t].indexBuffer);
+        }
+        tileBuffers.resize(tiles.NumTiles());
+        for(size_t t = 0; t < tileBuffers.size(); t++){
+            tileBuffers[t].filled = false;
+        }
     }
-    pointList.clear();
 
+    //Tiles out of view keep whatever they hold until they come back
+    tiles.Select(modelview, projection, viewport, TILE_TOLERANCE);
+    for(size_t t = 0; t < tiles.NumTiles(); t++){
+        const MountainTile & tile = tiles.Tile(t);
+        MountainTileBuffers & buffers = tileBuffers[t];
+        if(!tile.visible || (buffers.filled && buffers.version == tile.version)){
+            continue;
+        }
+        if(!buffers.vertexBuffer){
+            glGenBuffers(1, &buffers.vertexBuffer);
+            glGenBuffers(1, &buffers.indexBuffer);
+        }
+        if(paged){
+            tiles.Extract(blocks, t, tileVertices, tileStrip);
+        }
+        else{
+            tiles.Extract(grids, t, tileVertices, tileStrip);
+        }
+
+        buffers.packing.Fit(tile.bounds, tileStep);
+        buffers.packing.Pack(tileVertices, tilePacked);
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, tilePacked.size() * sizeof(struct MountainPackedVertex),
+                     tilePacked.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, tileStrip.size() * sizeof(uint32_t),
+                     tileStrip.data(), GL_STATIC_DRAW);
+        buffers.numIndices = (GLsizei)tileStrip.size();
+        buffers.filled = true;
+        buffers.version = tile.version;
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
+//Brings the grids to the level asked for, as deep as the maps go, and bakes
+//and uploads the maps and their coarse mesh again if that changed them.
+//Called from Draw, where the GL context is current
+void Mountain::UpdateNormalMap(){
+    StepGrids(std::min(targetLevel, NORMAL_MAP_MAX_LEVEL));
+    if(mappedVersion == gridVersion){
+        return;
+    }
+    normalMap.Bake(grids, NORMAL_MAP_COARSE_LEVEL);
 
-void Mountain::AddTriangle(struct point * p1, struct point * p2, struct point * p3, bool addToPointList){
-    if(addToPointList){
-        //We push points onto pointList for free later
-        pointList.push_back(p1);
-        pointList.push_back(p2);
-        pointList.push_back(p3);
+    GLsizei size = (GLsizei)normalMap.Size();
+    for(int m = 0; m < normalMap.NumMaps(); m++){
+        glBindTexture(GL_TEXTURE_2D, mapTextures[m]);
+        gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGBA8, size, size, GL_RGBA,
+                          GL_UNSIGNED_BYTE, normalMap.Texels(m));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     }
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    //Only make triangle if there exists a point with z > 0
-    if(p1->z > 0 || p2->z > 0 || p3->z > 0){
-        struct triangle* t = new triangle();
-        t->p1 = p1;
-        t->p2 = p2;
-        t->p3 = p3;
-        //Add triangle to vector
-        triList.push_back(t);
+    const std::vector<MountainMapVertex> & vertices = normalMap.Vertices();
+    const std::vector<uint32_t> & indices = normalMap.Indices();
+    glBindBuffer(GL_ARRAY_BUFFER, mapVertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(struct MountainMapVertex),
+                 vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mapIndexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t),
+                 indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    mapFirstIndex.resize(normalMap.NumMaps() + 1);
+    for(int m = 0; m <= normalMap.NumMaps(); m++){
+        mapFirstIndex[m] = (GLsizei)normalMap.FirstIndex(m);
     }
+
+    //The GL has its own copy of all of it now
+    normalMap.Release();
+    mappedVersion = gridVersion;
 }
-void Mountain::ResetSubdivision(){
-    ClearSubdivision();
 
-    //Reset update val
-    randUpdateVal = 10;
+//Draws the coarse mesh lit per texel by the maps, with lighting off and
+//the texture combiners doing its work: unit 0 takes the dot product of the
+//normal in the map with the direction to the light, which comes in as the
+//primary color, unit 1 adds the ambient light and unit 2 multiplies by the
+//gray in the map's alpha. Light 0 is taken to be the white directional
+//light the window sets up
+void Mountain::DrawNormalMap(const GLfloat modelview[16]){
+    //The light's direction is kept in eye space. The modelview only
+    //rotates and moves the mountain there, so its transpose turns it back
+    GLfloat light[4], ambient[4], lightAmbient[4];
+    glGetLightfv(GL_LIGHT0, GL_POSITION, light);
+    glGetLightfv(GL_LIGHT0, GL_AMBIENT, lightAmbient);
+    glGetFloatv(GL_LIGHT_MODEL_AMBIENT, ambient);
+    float direction[3], length = 0;
+    for(int k = 0; k < 3; k++){
+        direction[k] = modelview[k * 4] * light[0] + modelview[k * 4 + 1] * light[1]
+                     + modelview[k * 4 + 2] * light[2];
+        length += direction[k] * direction[k];
+        ambient[k] += lightAmbient[k];
+    }
+    length = length > 0 ? sqrtf(length) : 1;
+    glDisable(GL_LIGHTING);
+    glColor3f(direction[0] / length * 0.5f + 0.5f, direction[1] / length * 0.5f + 0.5f,
+              direction[2] / length * 0.5f + 0.5f);
 
-    //Initial subdivision triangle
-    struct point * p1 = new point();
-    struct point * p2 = new point();
-    struct point * p3 = new point();
+    glBindBuffer(GL_ARRAY_BUFFER, mapVertexBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(struct MountainMapVertex),
+                    (const GLvoid *)offsetof(struct MountainMapVertex, position));
+    for(int u = 0; u < NORMAL_MAP_UNITS; u++){
+        glActiveTexture(GL_TEXTURE0 + u);
+        glEnable(GL_TEXTURE_2D);
+        glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
+        glClientActiveTexture(GL_TEXTURE0 + u);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(2, GL_FLOAT, sizeof(struct MountainMapVertex),
+                          (const GLvoid *)offsetof(struct MountainMapVertex, texcoord));
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_DOT3_RGB);
+    glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE0_RGB, GL_TEXTURE);
+    glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND0_RGB, GL_SRC_COLOR);
+    glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE1_RGB, GL_PRIMARY_COLOR);
+    glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND1_RGB, GL_SRC_COLOR);
+    glActiveTexture(GL_TEXTURE1);
+    glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_ADD);
+    glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE0_RGB, GL_PREVIOUS);
+    glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND0_RGB, GL_SRC_COLOR);
+    glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE1_RGB, GL_CONSTANT);
+    glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND1_RGB, GL_SRC_COLOR);
+    glTexEnvfv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, ambient);
+    glActiveTexture(GL_TEXTURE2);
+    glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_MODULATE);
+    glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE0_RGB, GL_PREVIOUS);
+    glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND0_RGB, GL_SRC_COLOR);
+    glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE1_RGB, GL_TEXTURE);
+    glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND1_RGB, GL_SRC_ALPHA);
 
-    p1->x = -20;
-    p1->y = 50;
-    p1->z = 0;
+    //Every unit reads the same map, each base triangle's in turn
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mapIndexBuffer);
+    for(size_t m = 0; m < mapTextures.size(); m++){
+        for(int u = 0; u < NORMAL_MAP_UNITS; u++){
+            glActiveTexture(GL_TEXTURE0 + u);
+            glBindTexture(GL_TEXTURE_2D, mapTextures[m]);
+        }
+        glDrawElements(GL_TRIANGLES, mapFirstIndex[m + 1] - mapFirstIndex[m],
+                       GL_UNSIGNED_INT,
+                       (const GLvoid *)(mapFirstIndex[m] * sizeof(uint32_t)));
+    }
 
-    p2->x = 50;
-    p2->y = -20;
-    p2->z = 0;
+    for(int u = NORMAL_MAP_UNITS - 1; u >= 0; u--){
+        glActiveTexture(GL_TEXTURE0 + u);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+        glDisable(GL_TEXTURE_2D);
+        glClientActiveTexture(GL_TEXTURE0 + u);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    }
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glEnable(GL_LIGHTING);
+    glColor3f(1, 1, 1);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-    p3->x = 50;
-    p3->y = 50;
-    p3->z = 50;
+//Points the vertex arrays into a vertex buffer and draws from an index
+//buffer. The arrays must be enabled
+void Mountain::DrawBuffers(GLuint vertexBuffer, GLuint indexBuffer, GLenum mode,
+                           GLsizei numIndices){
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glVertexPointer(3, GL_FLOAT, sizeof(struct MountainVertex),
+                    (const GLvoid *)offsetof(struct MountainVertex, position));
+    glNormalPointer(GL_FLOAT, sizeof(struct MountainVertex),
+                    (const GLvoid *)offsetof(struct MountainVertex, normal));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(struct MountainVertex),
+                   (const GLvoid *)offsetof(struct MountainVertex, color));
 
-    AddTriangle(p1, p2, p3, true);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glDrawElements(mode, numIndices, GL_UNSIGNED_INT, 0);
+}
 
-    p1 = new point();
-    p2 = new point();
-    p3 = new point();
+//Draws the tiles in view from their packed buffers, each scaled back out of
+//its frame by the modelview matrix. The gray comes from the height through
+//a texture coordinate generated from z, so the vertices need no color
+void Mountain::DrawTiles(){
+    glEnable(GL_TEXTURE_1D);
+    glBindTexture(GL_TEXTURE_1D, grayTexture);
+    glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_OBJECT_LINEAR);
+    glEnable(GL_TEXTURE_GEN_S);
+    glColor3f(1, 1, 1);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
 
-    p1->x = -10;
-    p1->y = -50;
-    p1->z = 0;
+    //Texel k is gray k/255, at its center
+    float perGray = 255.0f / 256.0f;
+    float offset = 0.5f / 256.0f;
+    for(size_t t = 0; t < tileBuffers.size(); t++){
+        const MountainTileBuffers & buffers = tileBuffers[t];
+        if(!tiles.Tile(t).visible || !buffers.numIndices){
+            continue;
+        }
+        const MountainPacking & packing = buffers.packing;
+        GLfloat plane[4] = { 0, 0, perGray * packing.step / MountainMesh::GRAY_HEIGHT,
+                             perGray * (MountainMesh::GRAY_BASE +
+                                        packing.origin[2] / MountainMesh::GRAY_HEIGHT) + offset };
+        glTexGenfv(GL_S, GL_OBJECT_PLANE, plane);
 
-    p2->x = -50;
-    p2->y = -10;
-    p2->z = 0;
+        glPushMatrix();
+        glTranslatef(packing.origin[0], packing.origin[1], packing.origin[2]);
+        glScalef(packing.step, packing.step, packing.step);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexBuffer);
+        glVertexPointer(3, GL_SHORT, sizeof(struct MountainPackedVertex),
+                        (const GLvoid *)offsetof(struct MountainPackedVertex, position));
+        glNormalPointer(GL_BYTE, sizeof(struct MountainPackedVertex),
+                        (const GLvoid *)offsetof(struct MountainPackedVertex, normal));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.indexBuffer);
+        glDrawElements(GL_TRIANGLE_STRIP, buffers.numIndices, GL_UNSIGNED_INT, 0);
+        glPopMatrix();
+    }
 
-    p3->x = -50;
-    p3->y = -50;
-    p3->z = 20;
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisable(GL_TEXTURE_GEN_S);
+    glDisable(GL_TEXTURE_1D);
+    glBindTexture(GL_TEXTURE_1D, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-    AddTriangle(p1, p2, p3, true);
+void Mountain::DrawTriangles(void){
+    GLuint vertexBuffer = 0, indexBuffer = 0;
+    GLsizei numIndices = 0;
 
-    p1 = new point();
-    p2 = new point();
-    p3 = new point();
+    CollectBuild();
+    ReleaseDroppedBuffers();
 
-    p1->x = -50;
-    p1->y = 10;
-    p1->z = 0;
+    //The camera that is about to draw us, for the LOD and the tiles
+    GLfloat modelview[16], projection[16];
+    GLint viewport[4];
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    glGetIntegerv(GL_VIEWPORT, viewport);
 
-    p2->x = 10;
-    p2->y = 50;
-    p2->z = 0;
+    //The maps are drawn over their own mesh
+    if(!lodEnabled && normalMapEnabled){
+        UpdateNormalMap();
+        DrawNormalMap(modelview);
+        return;
+    }
 
-    p3->x = -50;
-    p3->y = 50;
-    p3->z = 20;
+    //The tiles are packed, and drawn their own way
+    if(!lodEnabled && gridEnabled){
+        UpdateGrid(modelview, projection, viewport);
+        DrawTiles();
+        return;
+    }
 
-    AddTriangle(p1, p2, p3, true);
+    if(lodEnabled){
+        //Refine for the camera
+        if(lod.Update(modelview, projection, viewport) || updated){
+            lod.Extract(lodMesh);
+            lodMesh.ComputeShading(shadingScratch);
+            lodNumIndices = UploadBuffers(lodMesh, lodVertexBuffer, lodIndexBuffer);
+            updated = false;
+        }
+        vertexBuffer = lodVertexBuffer;
+        indexBuffer = lodIndexBuffer;
+        numIndices = lodNumIndices;
+    }
+    else{
+        //Each level is uploaded the first time it is shown, and after that
+        //switching to it just binds its buffers
+        MountainLevel & current = levels[level];
+        if(!current.uploaded){
+            if(!current.vertexBuffer){
+                glGenBuffers(1, &current.vertexBuffer);
+                glGenBuffers(1, &current.indexBuffer);
+            }
+            uint32_t numVertices;
+            if(decimate && current.decimatedBuilt && current.decimated.NumTriangles()){
+                current.numIndices = UploadBuffers(current.decimated, current.vertexBuffer,
+                                                   current.indexBuffer);
+                numVertices = current.decimated.NumVertices();
+            }
+            else if(current.built){
+                current.numIndices = UploadBuffers(current.mesh, current.vertexBuffer,
+                                                   current.indexBuffer);
+                numVertices = current.mesh.NumVertices();
+            }
+            else{
+                current.numIndices = UploadBuffers(current.cache, current.vertexBuffer,
+                                                   current.indexBuffer);
+                numVertices = current.cache.NumVertices();
+            }
+            current.bufferBytes = numVertices * sizeof(struct MountainVertex)
+                                + current.numIndices * sizeof(uint32_t);
+            current.uploaded = true;
+            LimitPyramid();
+        }
+        vertexBuffer = current.vertexBuffer;
+        indexBuffer = current.indexBuffer;
+        numIndices = current.numIndices;
+    }
 
-    p1 = new point();
-    p2 = new point();
-    p3 = new point();
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    DrawBuffers(vertexBuffer, indexBuffer, GL_TRIANGLES, numIndices);
 
-    p1->x = 50;
-    p1->y = 0;
-    p1->z = 0;
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-    p2->x = 0;
-    p2->y = -50;
-    p2->z = 0;
+//The displacement range of a level. Computed as the same running product
+//each time, so a rebuilt level gets exactly the range it had before
+float Mountain::LevelRange(int l){
+    float range = MountainParams::BASE_RANGE;
+    for(int i = 0; i < l; i++){
+        range *= randUpdateRatio;
+    }
+    return range;
+}
 
-    p3->x = 50;
-    p3->y = -50;
-    p3->z = 40;
+uint64_t Mountain::CacheKey(int l){
+    return MountainCache::Key(seed, MountainParams::BASE_TRIANGLES,
+                              MountainParams::NUM_BASE_TRIANGLES, l,
+                              MountainParams::BASE_RANGE, randUpdateRatio, occludersKey);
+}
 
-    AddTriangle(p1, p2, p3, true);
+//Maps level l's cache file, if an earlier run saved one
+bool Mountain::OpenCachedLevel(int l){
+    if(l < CACHE_MIN_LEVEL){
+        return false;
+    }
+    uint64_t key = CacheKey(l);
+    return levels[l].cache.Open(MountainCache::FileName(key).c_str(), key);
+}
 
+//Whether level l can be drawn: built, or mapped from its cache file
+bool Mountain::LevelReady(int l){
+    return levels[l].built || levels[l].cache.IsOpen() || OpenCachedLevel(l);
 }
 
-// Initializer. Returns false if something went wrong, like not being able to
-// load the texture.
-bool
-Mountain::Initialize(void)
-{
-    randUpdateRatio = .6;
+//Whether level l's blocks are mapped, mapping them if an earlier run or the
+//builder wrote them
+bool Mountain::BlocksReady(int l){
+    uint64_t key = CacheKey(l);
+    if(blocks.IsOpen() && blocks.Key() == key){
+        return true;
+    }
+    return blocks.Open(MountainBlocks::FileName(key).c_str(), key);
+}
 
-    ResetSubdivision();
+//Whether level l is to be drawn simplified, and hasn't been yet
+bool Mountain::NeedsDecimation(int l){
+    if(!decimate || levels[l].decimatedBuilt){
+        return false;
+    }
+    uint32_t triangles = levels[l].built ? levels[l].mesh.NumTriangles()
+                                         : levels[l].cache.NumIndices() / 3;
+    return triangles > MountainParams::DECIMATE_BUDGET;
+}
 
-    // We only do all this stuff once, when the GL context is first set up.
-    initialized = true;
+//Starts building the lowest missing level on the way to targetLevel, or
+//decimating targetLevel once it is there, if the builder is idle. With the
+//grids, starts writing the blocks of targetLevel if it is too deep for them
+void Mountain::StartBuild(){
+    //Neither do the maps, which are baked from the grids
+    if(normalMapEnabled){
+        return;
+    }
+    //The grids don't use the pyramid
+    if(gridEnabled){
+        if(targetLevel <= GRID_MAX_LEVEL || BlocksReady(targetLevel) ||
+           CacheKey(targetLevel) == blocksFailed){
+            return;
+        }
+        std::unique_lock<std::mutex> lock(buildLock);
+        if(buildLevel >= 0){
+            return;
+        }
+        buildLevel = targetLevel;
+        buildDone = false;
+        buildSeed = seed;
+        buildKey = CacheKey(targetLevel);
+        buildBlocks = true;
+        buildRanges.resize(targetLevel);
+        for(int l = 0; l < targetLevel; l++){
+            buildRanges[l] = LevelRange(l);
+        }
+        if(!builder.joinable()){
+            builder = std::thread(&Mountain::BuilderLoop, this);
+        }
+        buildReady.notify_one();
+        return;
+    }
+    int l = targetLevel;
+    bool subdivide = !LevelReady(l);
+    if(!subdivide && !NeedsDecimation(l)){
+        return;
+    }
+    while(subdivide && !LevelReady(l - 1)){
+        l--;
+    }
 
-    return true;
+    std::unique_lock<std::mutex> lock(buildLock);
+    if(buildLevel >= 0){
+        return;
+    }
+    buildLevel = l;
+    buildDone = false;
+    buildSeed = seed;
+    buildRange = subdivide ? LevelRange(l - 1) : 0;
+    buildKey = subdivide && l >= CACHE_MIN_LEVEL ? CacheKey(l) : 0;
+    buildSubdivide = subdivide;
+    buildLoadSource = !levels[subdivide ? l - 1 : l].built;
+    buildDecimate = decimate && l == targetLevel;
+    buildBlocks = false;
+    if(!builder.joinable()){
+        builder = std::thread(&Mountain::BuilderLoop, this);
+    }
+    buildReady.notify_one();
 }
 
-//Generates a random float between +- randUpdateVal
-float Mountain::RandomFloat() {
-    float random = ((float) rand()) / (float) RAND_MAX;
-    float diff = 2*randUpdateVal;
-    float r = random * diff;
-    return -randUpdateVal + r;
+//Takes a finished level from the builder, shows it if it is the one asked
+//for, and starts on the next one needed
+void Mountain::CollectBuild(){
+    std::unique_lock<std::mutex> lock(buildLock);
+    if(buildLevel < 0 || !buildDone){
+        return;
+    }
+    int l = buildLevel;
+    buildLevel = -1;
+    lock.unlock();
+
+    //Blocks are mapped when they are wanted. If the ones asked for can't
+    //be, they couldn't be written, and aren't tried again
+    if(buildBlocks){
+        if(l == targetLevel && gridEnabled && !BlocksReady(l)){
+            blocksFailed = CacheKey(l);
+        }
+        StartBuild();
+        return;
+    }
+
+    if(buildLoadSource){
+        levels[buildSubdivide ? l - 1 : l].built = true;
+    }
+    levels[l].built = true;
+    levels[l].uploaded = false;
+    if(buildDecimate){
+        levels[l].decimatedBuilt = true;
+    }
+    if(l == targetLevel && buildSubdivide){
+        ShowLevel(l);
+    }
+    StartBuild();
 }
 
-//This function will look up if a vertex on edge p1-p2 already exists
-//If not, it will create it
-struct point* Mountain::GetPointFromEdge(struct point * p1, struct point * p2){
-    //Attempt to find existing points if it already exists
-    //Note that since edges are orderless, we test both permutations of endpoints
-    struct point * newP;
-    //Get all edge combinations
-    std::pair<struct point*, struct point*> p1p2 = std::pair<struct point*, struct point*>(p1, p2);
-    std::pair<struct point*, struct point*> p2p1 = std::pair<struct point*, struct point*>(p2, p1);
-    //If exists, use the point
-    if(edgePtLookup.count(p1p2) > 0){
-        newP = edgePtLookup.at(p1p2);
+//Waits for the builder to finish the level it is working on, if any, and
+//throws that level away
+void Mountain::CancelBuild(){
+    std::unique_lock<std::mutex> lock(buildLock);
+    while(buildLevel >= 0 && !buildDone){
+        buildFinished.wait(lock);
     }
-    else if(edgePtLookup.count(p2p1) > 0){
-        newP = edgePtLookup.at(p2p1);
+    buildLevel = -1;
+}
+
+//Runs on the builder thread. Subdivides into the requested level from the
+//one below it, until told to stop
+void Mountain::BuilderLoop(){
+    std::unique_lock<std::mutex> lock(buildLock);
+    while(true){
+        while((buildLevel < 0 || buildDone) && !stopping){
+            buildReady.wait(lock);
+        }
+        if(stopping){
+            return;
+        }
+        int l = buildLevel;
+        uint64_t s = buildSeed;
+        float range = buildRange;
+        uint64_t key = buildKey;
+        bool subdivide = buildSubdivide;
+        bool loadSource = buildLoadSource;
+        bool decimateLevel = buildDecimate;
+        bool blocksLevel = buildBlocks;
+        lock.unlock();
+
+        //Written straight to disk, a block at a time
+        if(blocksLevel){
+            std::string name = MountainBlocks::FileName(key);
+            if(MountainBlocks::Generate(name.c_str(), key,
+                                        MountainParams::BASE_TRIANGLES,
+                                        MountainParams::NUM_BASE_TRIANGLES, l,
+                                        l - BLOCK_LEVELS, s, buildRanges)){
+                MountainCache::Trim(MAX_CACHE_BYTES, name.c_str());
+            }
+            lock.lock();
+            buildDone = true;
+            buildFinished.notify_all();
+            continue;
+        }
+
+        MountainMesh & mesh = levels[l].mesh;
+        if(subdivide){
+            if(loadSource){
+                levels[l - 1].cache.Load(levels[l - 1].mesh);
+            }
+            subdivider.Subdivide(levels[l - 1].mesh, mesh, s, l - 1, range);
+
+            //Put the triangles in vertex cache order before anything else
+            //walks over them
+            optimizer.Optimize(mesh);
+
+            mesh.ComputeShading(buildScratch);
+            //Deeper levels keep the occlusion subdivision carried up to them
+            if(l <= MountainParams::OCCLUSION_MAX_LEVEL){
+                occlusion.SetSurface(mesh);
+                occlusion.Bake(mesh, occluderIndex);
+            }
+            //Saved here, before the main thread can drop the level again
+            if(key){
+                std::string name = MountainCache::FileName(key);
+                if(MountainCache::Save(name.c_str(), key, mesh)){
+                    MountainCache::Trim(MAX_CACHE_BYTES, name.c_str());
+                }
+            }
+        }
+        else if(loadSource){
+            levels[l].cache.Load(mesh);
+        }
+
+        //The full mesh is kept as well, as deeper levels are built from it
+        MountainMesh & decimated = levels[l].decimated;
+        decimated.Clear();
+        if(decimateLevel && mesh.NumTriangles() > MountainParams::DECIMATE_BUDGET){
+            decimator.Decimate(mesh, decimated, MountainParams::DECIMATE_BUDGET,
+                               MountainParams::DECIMATE_TOLERANCE);
+            optimizer.Optimize(decimated);
+            decimated.ComputeShading(buildScratch);
+        }
+
+        lock.lock();
+        buildDone = true;
+        buildFinished.notify_all();
     }
-    //Not found, create new point
-    else{
-        newP = new point();
-        //New points based on halfway points of 3 edges
-        newP->x = p1->x + (p2->x - p1->x)/2;
-        newP->y = p1->y + (p2->y - p1->y)/2;
-        newP->z = p1->z + (p2->z - p1->z)/2;
-        //Additinally, if the new z <= 0 (on the floor), dont change
-        //This will remove weird artifacts at the bottom of the mountain
-        if(newP->z > 0){
-            newP->z += RandomFloat();
-            //Constrain
-            if(newP->z < 0){
-                newP->z = 0;
+}
+
+//Drops levels until the pyramid fits in MAX_PYRAMID_BYTES, furthest from
+//the current level first. The base and current levels are always kept
+void Mountain::LimitPyramid(){
+    while(true){
+        size_t total = 0;
+        int furthest = -1;
+        for(int l = 0; l < (int)levels.size(); l++){
+            if(!levels[l].built && !levels[l].cache.IsOpen()){
+                continue;
+            }
+            //Never the levels the builder is using. Their meshes may be
+            //changing, so they are counted once the build is collected
+            bool building = buildLevel >= 0 && !buildBlocks &&
+                            (l == buildLevel || l == buildLevel - 1);
+            total += levels[l].bufferBytes;
+            if(!building){
+                total += levels[l].mesh.MemoryBytes() + levels[l].decimated.MemoryBytes();
             }
+            if(l != 0 && l != level && l != targetLevel && !building &&
+               (furthest < 0 || abs(l - level) >= abs(furthest - level))){
+                furthest = l;
+            }
+        }
+        if(total <= MAX_PYRAMID_BYTES || furthest < 0){
+            return;
+        }
+
+        //Its buffers are freed on the next draw, when the context is current
+        if(furthest == indexLevel){
+            indexLevel = -1;
         }
-        //Add this edge to the lookup
-        edgePtLookup[p1p2] = newP;
-        pointList.push_back(newP);
+        levels[furthest].mesh.Release();
+        levels[furthest].decimated.Release();
+        levels[furthest].cache.Close();
+        levels[furthest].built = false;
+        levels[furthest].decimatedBuilt = false;
+        levels[furthest].uploaded = false;
     }
-    return newP;
 }
 
-//Subdivides a given triangle and pushes it onto the triList
-void Mountain::SubdivideTriangle(struct triangle * t){
-    
-    struct point * p1 = t->p1;
-    struct point * p2 = t->p2;
-    struct point * p3 = t->p3;
+void Mountain::ReleaseDroppedBuffers(){
+    for(size_t l = 0; l < levels.size(); l++){
+        MountainLevel & dropped = levels[l];
+        if(!dropped.built && !dropped.cache.IsOpen() && dropped.vertexBuffer){
+            glDeleteBuffers(1, &dropped.vertexBuffer);
+            glDeleteBuffers(1, &dropped.indexBuffer);
+            dropped.vertexBuffer = dropped.indexBuffer = 0;
+            dropped.bufferBytes = 0;
+        }
+    }
+}
 
-    struct point * newP1 = GetPointFromEdge(p1, p2);
-    struct point * newP2 = GetPointFromEdge(p2, p3);
-    struct point * newP3 = GetPointFromEdge(p3, p1);
+void Mountain::ShowLevel(int l){
+    level = l;
+    randUpdateVal = LevelRange(l);
+    LimitPyramid();
+}
 
-    //GetPointFromEdge already adds the point to the pointList if necessary
-    AddTriangle(newP1, newP2, newP3, false);
-    AddTriangle(p1, newP1, newP3, false);
-    AddTriangle(newP1, p2, newP2, false);
-    AddTriangle(newP3, newP2, p3, false);
+void Mountain::RequestLevel(int l){
+    targetLevel = l;
+    if(l < MAX_LEVELS && LevelReady(l)){
+        ShowLevel(l);
+    }
+    //Builds it, or decimates it if it is shown already
+    StartBuild();
 }
 
-void Mountain::Subdivide(){
-    int numList = triList.size();
-    for(int i = 0; i < numList; i++){
-        struct triangle* t = triList[i];
-        //This function will add triangles to triList
-        SubdivideTriangle(t);
+void Mountain::SetDecimation(bool enable){
+    decimate = enable;
+    //Every level is uploaded again, simplified or in full
+    for(size_t l = 0; l < levels.size(); l++){
+        levels[l].uploaded = false;
+    }
+    if(initialized){
+        StartBuild();
+    }
+}
+
+void Mountain::SetGrid(bool enable){
+    gridEnabled = enable;
+    //The pyramid picks up where it left off, or as near as it goes
+    if(!enable && initialized){
+        if(targetLevel >= MAX_LEVELS){
+            RequestLevel(MAX_LEVELS - 1);
+        }
+        else{
+            StartBuild();
+        }
+    }
+}
+
+void Mountain::SetNormalMap(bool enable){
+    if(enable && initialized && !normalMapSupported){
+        fprintf(stderr, "Mountain: normal maps need %d texture units\n", NORMAL_MAP_UNITS);
+        return;
+    }
+    normalMapEnabled = enable;
+    //The pyramid or the blocks pick up where they left off
+    if(!enable && initialized){
+        StartBuild();
+    }
+}
+
+//Throws away every level, keeping the storage for the next seed
+void Mountain::ClearSubdivision(){
+    indexLevel = -1;
+    for(size_t l = 0; l < levels.size(); l++){
+        levels[l].mesh.Clear();
+        levels[l].decimated.Clear();
+        levels[l].cache.Close();
+        levels[l].built = false;
+        levels[l].decimatedBuilt = false;
+        levels[l].uploaded = false;
+    }
+}
+
+void Mountain::ResetSubdivision(){
+    //The pyramid still holds the levels of this seed, so they are kept
+    if(!levels[0].built || builtSeed != seed){
+        //A level being built for the old seed goes with the rest
+        CancelBuild();
+        ClearSubdivision();
+
+        //Initial subdivision triangles
+        MountainMesh & mesh = levels[0].mesh;
+        for(int i = 0; i < MountainParams::NUM_BASE_TRIANGLES; i++){
+            const float (*t)[3] = MountainParams::BASE_TRIANGLES[i];
+            uint32_t i1 = mesh.AddVertex(t[0][0], t[0][1], t[0][2]);
+            uint32_t i2 = mesh.AddVertex(t[1][0], t[1][1], t[1][2]);
+            uint32_t i3 = mesh.AddVertex(t[2][0], t[2][1], t[2][2]);
+            mesh.AddTriangle(i1, i2, i3);
+        }
+        //Subdivision carries the adjacency up from here
+        mesh.LinkTwins();
+        mesh.ComputeShading(shadingScratch);
+        levels[0].built = true;
+        builtSeed = seed;
+
+        lod.Reset(MountainParams::BASE_TRIANGLES, MountainParams::NUM_BASE_TRIANGLES, seed,
+                  MountainParams::BASE_RANGE, randUpdateRatio, LOD_MAX_LEVEL);
+        lod.SetBudget(LOD_BUDGET);
+        lod.SetTolerance(LOD_TOLERANCE);
+
+        //The LOD buffers are refilled on the next draw
+        updated = true;
+    }
+
+    RequestLevel(0);
+}
+
+void Mountain::SetOccluders(const std::vector<float> & corners){
+    uint64_t key = MountainRandom::Mix(corners.size());
+    for(size_t i = 0; i < corners.size(); i++){
+        uint32_t bits;
+        memcpy(&bits, &corners[i], sizeof(bits));
+        key = MountainRandom::Mix(key ^ bits);
+    }
+    if(key == occludersKey){
+        return;
+    }
+
+    //Every level was baked with the old ones
+    CancelBuild();
+    ClearSubdivision();
+    occluders.Clear();
+    for(size_t i = 0; i + 9 <= corners.size(); i += 9){
+        for(int c = 0; c < 3; c++){
+            occluders.indices.push_back(occluders.AddVertex(corners[i + c * 3],
+                                                            corners[i + c * 3 + 1],
+                                                            corners[i + c * 3 + 2]));
+        }
+    }
+    occluderIndex.Build(occluders);
+    occludersKey = key;
+    if(initialized){
+        ResetSubdivision();
     }
+}
 
-    //Clear old triangles
-    for(int i = 0; i < numList; i++){
-        delete triList[i];
+//Indexes the level shown, if the index is of another. Nothing is shown
+//before the first reset, and then the index is left empty
+void Mountain::UpdateIndex(){
+    if(indexLevel == level){
+        return;
+    }
+    MountainLevel & current = levels[level];
+    if(current.built){
+        index.Build(current.mesh);
+    }
+    else if(current.cache.IsOpen()){
+        index.Build(current.cache);
     }
-    
-    //Erase from vector
-    triList.erase(triList.begin(), triList.begin() + numList);
+    else{
+        index.Clear();
+        return;
+    }
+    indexLevel = level;
+}
+
+float Mountain::Height(float x, float y){
+    float z;
+    UpdateIndex();
+    return index.Height(x, y, z) ? z : 0;
+}
+
+void Mountain::Heights(size_t n, const float points[][2], float heights[]){
+    UpdateIndex();
+    index.Heights(n, points, heights, 0);
+}
 
-    randUpdateVal *= randUpdateRatio;
+bool Mountain::Intersect(const float origin[3], const float direction[3],
+                         float maxDistance, MountainIndex::Hit & hit){
+    UpdateIndex();
+    return index.Intersect(origin, direction, maxDistance, hit);
 }
 
+void Mountain::Intersect(size_t n, const float origins[][3], const float directions[][3],
+                         float maxDistance, MountainIndex::Hit hits[]){
+    UpdateIndex();
+    index.Intersect(n, origins, directions, maxDistance, hits);
+}
+
+bool Mountain::Nearest(const float point[3], MountainIndex::Hit & hit){
+    UpdateIndex();
+    return index.Nearest(point, hit);
+}
+
+void Mountain::Nearest(size_t n, const float points[][3], MountainIndex::Hit hits[]){
+    UpdateIndex();
+    index.Nearest(n, points, hits);
+}
+
+// Initializer. Returns false if something went wrong, like not being able to
+// load the texture.
+bool
+Mountain::Initialize(void)
+{
+    randUpdateRatio = MountainParams::RANGE_RATIO;
+
+    // The context can be recreated, but the buffers only need making once.
+    if ( ! initialized )
+    {
+        glGenBuffers(1, &lodVertexBuffer);
+        glGenBuffers(1, &lodIndexBuffer);
 
-// Draw just calls the display list we set up earlier.
+        //A ramp from black to white, for the grays of the tiles
+        GLubyte ramp[256];
+        for(int k = 0; k < 256; k++){
+            ramp[k] = (GLubyte)k;
+        }
+        glGenTextures(1, &grayTexture);
+        glBindTexture(GL_TEXTURE_1D, grayTexture);
+        glTexImage1D(GL_TEXTURE_1D, 0, GL_LUMINANCE, 256, 0, GL_LUMINANCE,
+                     GL_UNSIGNED_BYTE, ramp);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_1D, 0);
+
+        //Unit 0 lights the maps, and they take two more to shade
+        GLint units = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_UNITS, &units);
+        normalMapSupported = units >= NORMAL_MAP_UNITS;
+        if(!normalMapSupported){
+            normalMapEnabled = false;
+        }
+        mapTextures.resize(MountainParams::NUM_BASE_TRIANGLES);
+        glGenTextures(MountainParams::NUM_BASE_TRIANGLES, mapTextures.data());
+        glGenBuffers(1, &mapVertexBuffer);
+        glGenBuffers(1, &mapIndexBuffer);
+    }
+
+    ResetSubdivision();
+
+    //Start from the deepest level an earlier run saved, if there is one
+    for(int l = MAX_LEVELS - 1; l >= CACHE_MIN_LEVEL && !initialized; l--){
+        if(OpenCachedLevel(l)){
+            RequestLevel(l);
+            break;
+        }
+    }
+
+    // We only do all this stuff once, when the GL context is first set up.
+    initialized = true;
+
+    return true;
+}
+
+void Mountain::Subdivide(){
+    int deepest = normalMapEnabled ? NORMAL_MAP_MAX_LEVEL :
+                  gridEnabled ? BLOCK_MAX_LEVEL : MAX_LEVELS - 1;
+    if(targetLevel < deepest){
+        RequestLevel(targetLevel + 1);
+    }
+}
+
+void Mountain::Unsubdivide(){
+    if(targetLevel > 0){
+        RequestLevel(targetLevel - 1);
+    }
+}
+
+
+// Draw the current level from the buffers, with a single draw call.
 void
 Mountain::Draw(void)
 {
@@ -283,5 +1053,3 @@ Mountain::Draw(void)
     DrawTriangles();
     glPopMatrix();
 }
-
-
@@ -10,19 +10,56 @@
 
 #include <Fl/gl.h>
 #include <vector>
-#include <map>
 #include <stdlib.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "MountainMesh.h"
+#include "MountainSubdivider.h"
+#include "MountainLOD.h"
+#include "MountainCache.h"
+#include "MountainOptimizer.h"
+#include "MountainDecimator.h"
+#include "MountainGrid.h"
+#include "MountainTiles.h"
+#include "MountainBlocks.h"
+#include "MountainPacking.h"
+#include "MountainIndex.h"
+#include "MountainOcclusion.h"
+#include "MountainNormalMap.h"
+#include "MountainParams.h"
 
-struct point{
-    float x;
-    float y;
-    float z;
+//One level of the pyramid of subdivisions
+struct MountainLevel{
+    bool    built;          // Whether mesh holds this level
+    MountainMesh mesh;
+    MountainCache cache;    // The level's cache file, if it was found there
+    GLuint  vertexBuffer;   // Buffers holding the level once it has been drawn,
+    GLuint  indexBuffer;    // 0 until then
+    GLsizei numIndices;     // Number of indices in indexBuffer
+    size_t  bufferBytes;    // GPU memory held by the buffers
+    bool    uploaded;       // Whether the buffers hold the mesh to draw
+    //The level simplified to the decimation budget, drawn instead of mesh
+    //when decimation is on. Empty if the level is within the budget
+    bool    decimatedBuilt;
+    MountainMesh decimated;
+
+    MountainLevel(void) { built = false; vertexBuffer = indexBuffer = 0;
+                          numIndices = 0; bufferBytes = 0; uploaded = false;
+                          decimatedBuilt = false; };
 };
 
-struct triangle{
-    struct point * p1;
-    struct point * p2;
-    struct point * p3;
+//The buffers of one grid tile, filled at the details it was last seen at
+struct MountainTileBuffers{
+    GLuint  vertexBuffer;   // 0 until the tile is first drawn
+    GLuint  indexBuffer;
+    GLsizei numIndices;
+    bool    filled;         // Whether they hold the tile as it is now cut
+    uint32_t version;       // The tile's version when they were filled
+    MountainPacking packing;// The frame its vertices are packed in
+
+    MountainTileBuffers(void) { vertexBuffer = indexBuffer = 0; numIndices = 0;
+                                filled = false; version = 0; };
 };
 
 class Mountain {
@@ -30,38 +67,246 @@ class Mountain {
     //GLubyte display_list;   // The display list that does all the work.
     //GLuint  texture_obj;    // The object for the grass texture.
     bool    initialized;    // Whether or not we have been initialised.
-    bool    updated;
-    float   randUpdateVal;
+    bool    updated;        // Whether the LOD buffers need refilling
+    float   randUpdateVal;  // Displacement range of the current level
     float   randUpdateRatio;
+    uint64_t seed;          // Fully determines the terrain
+    uint64_t builtSeed;     // The seed the pyramid was built with
+    int     level;          // The level being shown
+    int     targetLevel;    // The level asked for, shown once it is built
+
+    //Every level computed so far, within MAX_PYRAMID_BYTES. A level that
+    //was dropped is rebuilt from the nearest one below it, which gives
+    //exactly the same mesh because the terrain is a function of the seed.
+    //Sized once to MAX_LEVELS, so the builder can hold on to entries
+    std::vector<MountainLevel> levels;
+
+    //Shared by the ComputeShading calls made on the main thread
+    MountainMesh::ShadingScratch shadingScratch;
+
+    //Levels are built on a separate thread, one at a time, while the
+    //current one keeps being drawn. The builder only touches the meshes of
+    //the level it is building and the mesh of the one below it, and nothing
+    //else touches those until the build has been collected
+    std::thread builder;
+    std::mutex buildLock;
+    std::condition_variable buildReady;     // A build or stop was requested
+    std::condition_variable buildFinished;  // The builder finished a level
+    //Guarded by buildLock
+    int     buildLevel;     // Level being built, or -1
+    bool    buildDone;      // Whether it is ready to collect
+    uint64_t buildSeed;     // The seed and range to build it with
+    float   buildRange;
+    uint64_t buildKey;      // Its cache key
+    bool    buildSubdivide; // Whether to build it from the level below, or
+                            // only decimate it
+    bool    buildLoadSource;// Whether the level read from must be loaded from
+                            // its cache file first
+    bool    buildDecimate;  // Whether to make its decimated mesh
+    bool    buildBlocks;    // Whether to write it to a block file instead
+    std::vector<float> buildRanges; // The range of every level, for writing
+                                    // the block file
+    bool    stopping;       // Tells the builder to exit
+    //Only used by the builder
+    MountainSubdivider subdivider;
+    MountainOptimizer optimizer;
+    MountainDecimator decimator;
+    MountainOcclusion occlusion;
+    MountainMesh::ShadingScratch buildScratch;
+
+    //What stands on the mountain and shades it, for baking occlusion. Only
+    //changed while nothing is being built
+    MountainMesh occluders;
+    MountainIndex occluderIndex;
+    uint64_t occludersKey;  // Hash of their triangles, part of the cache key
 
-    //This stores a list of triangles
-    std::vector <struct triangle*> triList;
-    //This stores all points in a list
-    //This is only used for deleting the memory during a reset
-    std::vector <struct point*> pointList;
+    //Whether levels over DECIMATE_BUDGET are drawn simplified
+    bool    decimate;
 
-    //A map that takes an edge in the form of a pair and returns an existing point on that edge
-    std::map <std::pair<struct point*, struct point*>, struct point*> edgePtLookup;
+    //View-dependent refinement, used instead of the levels when enabled
+    bool    lodEnabled;
+    MountainLOD lod;
+    //The triangles the LOD currently selects
+    MountainMesh lodMesh;
+    GLuint  lodVertexBuffer;
+    GLuint  lodIndexBuffer;
+    GLsizei lodNumIndices;
 
-    void DrawTriangle(struct triangle* t);
+    //Heightfields generated straight to the level asked for, used instead
+    //of the pyramid when enabled. One per base triangle, stepped a level at
+    //a time through gridScratch, on the main thread
+    bool    gridEnabled;
+    uint64_t gridSeed;      // The seed the grids were generated with
+    uint32_t gridVersion;   // Counts the changes to the grids
+    std::vector<MountainGrid> grids;
+    std::vector<MountainGrid> gridScratch;
+    //The grids cut into tiles, each drawn from its own buffers of packed
+    //vertices at its own level of detail, and only when in view
+    MountainTiles tiles;
+    std::vector<MountainTileBuffers> tileBuffers;
+    std::vector<MountainVertex> tileVertices;   // Scratch for filling them
+    std::vector<MountainPackedVertex> tilePacked;
+    std::vector<uint32_t> tileStrip;
+    float   tileStep;       // The packing step of every tile
+    GLuint  grayTexture;    // Gray by height, as the tiles have no colors
+    //Levels too deep for the grids, mapped from the block file of the one
+    //asked for
+    MountainBlocks blocks;
+    uint64_t tiledKey;      // Key of the blocks the tiles are cut from, or 0
+    uint32_t tiledVersion;  // The grids' version when they were cut
+    uint64_t blocksFailed;  // Key of blocks that couldn't be written
+
+    //The normals of the grids baked into a map per base triangle and, when
+    //enabled, drawn over a coarse mesh of them instead of the levels or the
+    //tiles, so the light shows the grids' detail for the triangles of the
+    //coarse level. Baked on the main thread when the grids change
+    bool    normalMapEnabled;
+    bool    normalMapSupported; // Whether there are texture units enough
+    MountainNormalMap normalMap;
+    uint32_t mappedVersion; // The grids' version when they were baked
+    std::vector<GLuint> mapTextures;
+    GLuint  mapVertexBuffer;// The coarse mesh of every map
+    GLuint  mapIndexBuffer;
+    std::vector<GLsizei> mapFirstIndex; // Where the indices drawn with each
+                                        // map start, and the last's end
+
+    //Answers queries on the surface of the level shown, reading its mesh
+    //or cache file in place. Built on the first query after the level
+    //changes
+    MountainIndex index;
+    int     indexLevel;     // The level it indexes, or -1
+
+    float LevelRange(int l);
+    uint64_t CacheKey(int l);
+    bool OpenCachedLevel(int l);
+    bool LevelReady(int l);
+    bool BlocksReady(int l);
+    bool NeedsDecimation(int l);
+    void RequestLevel(int l);
+    void ShowLevel(int l);
+    void StartBuild();
+    void CollectBuild();
+    void CancelBuild();
+    void BuilderLoop();
+    void LimitPyramid();
+    void ReleaseDroppedBuffers();
+    GLsizei UploadBuffers(const MountainMesh & source, GLuint vertexBuffer,
+                          GLuint indexBuffer);
+    GLsizei UploadBuffers(const MountainCache & source, GLuint vertexBuffer,
+                          GLuint indexBuffer);
+    void StepGrids(int target);
+    void UpdateGrid(const GLfloat modelview[16], const GLfloat projection[16],
+                    const GLint viewport[4]);
+    void UpdateNormalMap();
+    void DrawBuffers(GLuint vertexBuffer, GLuint indexBuffer, GLenum mode,
+                     GLsizei numIndices);
+    void DrawTiles();
+    void DrawNormalMap(const GLfloat modelview[16]);
     void DrawTriangles();
-    float RandomFloat();
-    void SubdivideTriangle(struct triangle* t);
-    struct point* GetPointFromEdge(struct point * p1, struct point * p2);
     void ClearSubdivision();
-    void AddTriangle(struct point * p1, struct point * p2, struct point * p3, bool addToPointList);
+    void UpdateIndex();
+
+    static const int	MAX_LEVELS;		// Levels the pyramid can hold.
+    static const size_t	MAX_PYRAMID_BYTES;	// Memory the levels may use.
+    static const int	CACHE_MIN_LEVEL;	// Shallowest level worth saving.
+    static const uint64_t MAX_CACHE_BYTES;	// Disk the saved levels may use.
+
+    static const int	LOD_MAX_LEVEL;	// Finest detail the LOD refines to.
+    static const int	LOD_BUDGET;	// Triangles the LOD aims for.
+    static const float	LOD_TOLERANCE;	// Screen error in pixels it accepts.
+
+    static const int	GRID_MAX_LEVEL;	// Deepest level the grids generate.
+    static const int	TILE_LEVEL;	// Tiles per grid, as a power of four.
+    static const float	TILE_TOLERANCE;	// Screen error in pixels they accept.
+    static const int	BLOCK_MAX_LEVEL;// Deepest level written in blocks.
+    static const int	BLOCK_LEVELS;	// Levels generated within a block.
+
+    static const int	NORMAL_MAP_MAX_LEVEL;	// Deepest level mapped.
+    static const int	NORMAL_MAP_COARSE_LEVEL;// Level the maps are drawn on.
+    static const int	NORMAL_MAP_UNITS;	// Texture units they take.
 
   public:
     // Constructor. Can't do initialization here because we are
     // created before the OpenGL context is set up.
-    Mountain(void) { initialized = false; };
+    Mountain(void) { initialized = false; updated = false; seed = 1;
+                     builtSeed = 0; level = targetLevel = 0; lodEnabled = false;
+                     decimate = false;
+                     lodVertexBuffer = lodIndexBuffer = 0; lodNumIndices = 0;
+                     gridEnabled = false; gridSeed = 0; gridVersion = 0;
+                     normalMapEnabled = normalMapSupported = false;
+                     mappedVersion = 0; mapVertexBuffer = mapIndexBuffer = 0;
+                     tiledKey = blocksFailed = 0; tiledVersion = 0; tileStep = 1; grayTexture = 0;
+                     indexLevel = -1; occludersKey = 0;
+                     std::vector<MountainLevel>(MAX_LEVELS).swap(levels);
+                     buildLevel = -1;
+                     buildDone = buildBlocks = stopping = false; };
+
+    // Moves one level finer, one level coarser, or back to the base
+    // triangles. Levels already in the pyramid are shown immediately.
+    // Others are built in the background and shown by the first draw
+    // after they are ready; until then the current level is drawn.
     void Subdivide(void);
+    void Unsubdivide(void);
     void ResetSubdivision();
+    int  Level(void) { return level; };
+
+    // The seed the terrain is generated from. Setting it takes effect at
+    // the next reset.
+    void SetSeed(uint64_t newSeed) { seed = newSeed; };
+    uint64_t Seed(void) { return seed; };
+
+    // Switches between drawing levels in full and drawing them simplified
+    // to a fixed budget of triangles. The simplified level is made in the
+    // background, and shown once it is ready.
+    void SetDecimation(bool enable);
+    bool Decimation(void) { return decimate; };
+
+    // Switches between drawing the current subdivision level and refining
+    // the mountain each frame for the view.
+    void SetLOD(bool enable) { lodEnabled = enable; updated = true; };
+    bool LOD(void) { return lodEnabled; };
+
+    // Switches between the pyramid of subdivided meshes and generating
+    // each level as a heightfield, which is faster and much smaller. Both
+    // give the same terrain. Levels past GRID_MAX_LEVEL, up to
+    // BLOCK_MAX_LEVEL, are generated in the background into a file of
+    // blocks that is paged in as it is drawn. The heightfield is drawn in
+    // tiles, each culled and coarsened for the view on its own down from
+    // the level asked for.
+    void SetGrid(bool enable);
+    bool Grid(void) { return gridEnabled; };
+
+    // Switches to drawing the level asked for, up to NORMAL_MAP_MAX_LEVEL,
+    // as the triangles of NORMAL_MAP_COARSE_LEVEL lit by normal maps baked
+    // from it, which costs no more to draw the deeper the level is. Needs
+    // NORMAL_MAP_UNITS texture units, and stays off without them.
+    void SetNormalMap(bool enable);
+    bool NormalMap(void) { return normalMapEnabled; };
+
+    // The triangles of things standing on the mountain, nine floats each,
+    // which darken the ambient occlusion baked into its levels along with
+    // the mountain itself. Levels already built are rebuilt with them.
+    void SetOccluders(const std::vector<float> & corners);
+
+    // Where the surface of the level shown by the pyramid is, for putting
+    // things on the terrain. It is the same terrain the LOD and the grids
+    // draw, at that level's detail. Heights off the mountain are those of
+    // the ground, 0. Ray distances are in lengths of the direction. The
+    // batched forms spread the queries over all cores.
+    float Height(float x, float y);
+    void Heights(size_t n, const float points[][2], float heights[]);
+    bool Intersect(const float origin[3], const float direction[3],
+                   float maxDistance, MountainIndex::Hit & hit);
+    void Intersect(size_t n, const float origins[][3], const float directions[][3],
+                   float maxDistance, MountainIndex::Hit hits[]);
+    bool Nearest(const float point[3], MountainIndex::Hit & hit);
+    void Nearest(size_t n, const float points[][3], MountainIndex::Hit hits[]);
 
-    // Destructor. Frees the display lists and texture object.
+    // Destructor. Stops the builder and frees the vertex and index
+    // buffers of every level.
     ~Mountain(void);
 
-    // Initializer. Creates the display list.
+    // Initializer. Creates the buffers and the starting triangles.
     bool    Initialize(void);
 
     // Does the drawing.
@@ -0,0 +1,361 @@
+/*
+ * MountainBenchmark.cpp: Times generating the mountain level by level, with
+ * no window, and prints the results as JSON.
+ *
+ * Usage: mountain_benchmark [-levels n] [-backend mesh|grid|all]
+ *			     [-seed s] [-repeat r]
+ *
+ * The mesh backend builds the pyramid as the builder thread does: subdivide,
+ * optimize, shade and bake the occlusion of each level from the one before,
+ * keeping every level. The vertex cache miss ratio is reported both for the
+ * order the subdivider leaves and for the optimized one. Nothing stands on the mountain here, so it only
+ * shades itself. It also times interleaving each level into the layout its
+ * buffers are filled with, which is the work drawing a level the first time
+ * does before the driver gets it, and clearing the whole pyramid at the end.
+ * The grid backend steps the heightfields of the base triangles. Both count
+ * only the triangles that are drawn, leaving out those entirely on the
+ * ground, so their rates compare. Each step is repeated r times and the
+ * fastest run is reported.
+ *
+ * Peak RSS is that of the whole process so far, so when both backends are
+ * run the mesh levels, which come second, include the grids.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <sys/resource.h>
+#include "MountainMesh.h"
+#include "MountainSubdivider.h"
+#include "MountainOptimizer.h"
+#include "MountainOcclusion.h"
+#include "MountainGrid.h"
+#include "MountainParams.h"
+#include "Parallel.h"
+
+// Level 14 would overflow the 32-bit indices of the mesh.
+static const int    MAX_MESH_LEVEL = 13;
+// Past this a grid's sample count overflows 32 bits.
+static const int    MAX_GRID_LEVEL = 15;
+
+
+static double
+Now(void)
+{
+    return std::chrono::duration<double>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// The most memory the process has held so far.
+static size_t
+PeakRSS(void)
+{
+    struct rusage   usage;
+    if ( getrusage(RUSAGE_SELF, &usage) )
+	return 0;
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+
+// The range of level l, computed as Mountain::LevelRange does.
+static float
+LevelRange(int l)
+{
+    float   range = MountainParams::BASE_RANGE;
+    for ( int i = 0 ; i < l ; i++ )
+	range *= MountainParams::RANGE_RATIO;
+    return range;
+}
+
+
+// The fraction of half-edges that have a twin.
+static double
+TwinOccupancy(const MountainMesh &mesh)
+{
+    if ( ! mesh.HasTwins() || mesh.indices.empty() )
+	return 0.0;
+
+    size_t  linked = 0;
+    for ( size_t h = 0 ; h < mesh.twins.size() ; h++ )
+	if ( mesh.twins[h] != MountainMesh::NO_TWIN )
+	    linked++;
+    return (double)linked / (double)mesh.twins.size();
+}
+
+
+static double
+PerTriangle(double value, uint32_t triangles)
+{
+    return triangles ? value / triangles : 0.0;
+}
+
+
+static void
+BenchmarkMesh(int max_level, uint64_t seed, int repeat)
+{
+    std::vector<MountainMesh>	levels(max_level + 1);
+    MountainSubdivider		subdivider;
+    MountainOptimizer		optimizer;
+    MountainOcclusion		occlusion;
+    MountainIndex		occluders;
+    MountainMesh::ShadingScratch    scratch;
+    std::vector<MountainVertex>	vertices;
+    std::vector<uint32_t>	indices;
+    size_t			pyramid_bytes = 0;
+
+    printf("    {\n      \"backend\": \"mesh\",\n      \"levels\": [\n");
+    for ( int l = 0 ; l <= max_level ; l++ )
+    {
+	MountainMesh	&mesh = levels[l];
+	double	subdivide = 0.0, optimize = 0.0, shade = 0.0, bake = 0.0;
+	double	upload = 0.0;
+	float	acmr = 0.0f, subdivided_acmr = 0.0f;
+
+	for ( int r = 0 ; r < repeat ; r++ )
+	{
+	    double  start = Now();
+	    if ( l == 0 )
+	    {
+		mesh.Clear();
+		for ( int i = 0 ; i < MountainParams::NUM_BASE_TRIANGLES ; i++ )
+		{
+		    const float (*t)[3] = MountainParams::BASE_TRIANGLES[i];
+		    uint32_t	i1 = mesh.AddVertex(t[0][0], t[0][1], t[0][2]);
+		    uint32_t	i2 = mesh.AddVertex(t[1][0], t[1][1], t[1][2]);
+		    uint32_t	i3 = mesh.AddVertex(t[2][0], t[2][1], t[2][2]);
+		    mesh.AddTriangle(i1, i2, i3);
+		}
+		mesh.LinkTwins();
+	    }
+	    else
+		subdivider.Subdivide(levels[l - 1], mesh, seed, l - 1,
+				     LevelRange(l - 1));
+	    double  subdivided = Now();
+	    // The order the subdivider leaves, to show what reordering gains.
+	    // Measured outside the timings.
+	    if ( r == 0 )
+		subdivided_acmr = MountainOptimizer::ACMR(mesh);
+	    double  measured = Now();
+	    if ( l > 0 )
+		optimizer.Optimize(mesh);
+	    double  optimized = Now();
+	    mesh.ComputeShading(scratch);
+	    double  shaded = Now();
+	    if ( l > 0 && l <= MountainParams::OCCLUSION_MAX_LEVEL )
+	    {
+		occlusion.SetSurface(mesh);
+		occlusion.Bake(mesh, occluders);
+	    }
+	    double  baked = Now();
+
+	    // Stands in for the mapped buffers UploadBuffers writes to.
+	    vertices.resize(mesh.NumVertices());
+	    mesh.Interleave(vertices.data());
+	    indices.assign(mesh.indices.begin(), mesh.indices.end());
+	    double  uploaded = Now();
+
+	    if ( r == 0 || subdivided - start < subdivide )
+		subdivide = subdivided - start;
+	    if ( r == 0 || optimized - measured < optimize )
+		optimize = optimized - measured;
+	    if ( r == 0 || shaded - optimized < shade )
+		shade = shaded - optimized;
+	    if ( r == 0 || baked - shaded < bake )
+		bake = baked - shaded;
+	    if ( r == 0 || uploaded - baked < upload )
+		upload = uploaded - baked;
+	}
+	acmr = MountainOptimizer::ACMR(mesh);
+
+	uint32_t    triangles = mesh.NumTriangles();
+	size_t	    mesh_bytes = mesh.MemoryBytes();
+	size_t	    scratch_bytes = subdivider.MemoryBytes() + optimizer.MemoryBytes()
+				    + occlusion.MemoryBytes();
+	double	    build = subdivide + optimize + shade + bake;
+	pyramid_bytes += mesh_bytes;
+
+	printf("        {\n");
+	printf("          \"level\": %d,\n", l);
+	printf("          \"triangles\": %u,\n", triangles);
+	printf("          \"vertices\": %u,\n", mesh.NumVertices());
+	printf("          \"seconds\": %.6f,\n", build);
+	printf("          \"subdivide_seconds\": %.6f,\n", subdivide);
+	printf("          \"optimize_seconds\": %.6f,\n", optimize);
+	printf("          \"shade_seconds\": %.6f,\n", shade);
+	printf("          \"occlusion_seconds\": %.6f,\n", bake);
+	printf("          \"upload_seconds\": %.6f,\n", upload);
+	printf("          \"triangles_per_second\": %.0f,\n",
+	       build > 0.0 ? triangles / build : 0.0);
+	printf("          \"mesh_bytes\": %zu,\n", mesh_bytes);
+	printf("          \"scratch_bytes\": %zu,\n", scratch_bytes);
+	printf("          \"pyramid_bytes\": %zu,\n", pyramid_bytes);
+	printf("          \"bytes_per_triangle\": %.2f,\n",
+	       PerTriangle((double)mesh_bytes, triangles));
+	printf("          \"scratch_bytes_per_triangle\": %.2f,\n",
+	       PerTriangle((double)scratch_bytes, triangles));
+	printf("          \"twin_occupancy\": %.6f,\n", TwinOccupancy(mesh));
+	printf("          \"subdivided_acmr\": %.4f,\n", subdivided_acmr);
+	printf("          \"acmr\": %.4f,\n", acmr);
+	printf("          \"peak_rss_bytes\": %zu\n", PeakRSS());
+	printf("        }%s\n", l < max_level ? "," : "");
+	fflush(stdout);
+    }
+
+    // Mountain::ClearSubdivision keeps the storage for the next seed, and
+    // LimitPyramid releases it.
+    double  start = Now();
+    for ( int l = 0 ; l <= max_level ; l++ )
+	levels[l].Clear();
+    double  cleared = Now();
+    for ( int l = 0 ; l <= max_level ; l++ )
+	levels[l].Release();
+    double  released = Now();
+
+    printf("      ],\n");
+    printf("      \"clear_seconds\": %.6f,\n", cleared - start);
+    printf("      \"release_seconds\": %.6f\n", released - cleared);
+    printf("    }");
+}
+
+
+// The lattice triangles of grid that are drawn, which leaves out those
+// entirely on the ground, as the mesh does.
+static uint64_t
+GridTriangles(const MountainGrid &grid)
+{
+    uint32_t	steps = grid.Steps();
+    uint64_t	triangles = 0;
+    for ( uint32_t j = 0 ; j < steps ; j++ )
+	for ( uint32_t i = 0 ; i + j < steps ; i++ )
+	{
+	    float   z00 = grid.Height(i, j), z10 = grid.Height(i + 1, j);
+	    float   z01 = grid.Height(i, j + 1);
+	    if ( MountainMesh::AboveGround(z00, z10, z01) )
+		triangles++;
+	    if ( i + j + 2 <= steps
+		 && MountainMesh::AboveGround(z10, grid.Height(i + 1, j + 1), z01) )
+		triangles++;
+	}
+    return triangles;
+}
+
+
+static void
+BenchmarkGrid(int max_level, uint64_t seed, int repeat)
+{
+    std::vector<MountainGrid>	grids(MountainParams::NUM_BASE_TRIANGLES);
+    std::vector<MountainGrid>	scratch(MountainParams::NUM_BASE_TRIANGLES);
+
+    printf("    {\n      \"backend\": \"grid\",\n      \"levels\": [\n");
+    for ( int l = 0 ; l <= max_level ; l++ )
+    {
+	double	seconds = 0.0;
+
+	for ( int r = 0 ; r < repeat ; r++ )
+	{
+	    double  start = Now();
+	    for ( int i = 0 ; i < MountainParams::NUM_BASE_TRIANGLES ; i++ )
+	    {
+		if ( l == 0 )
+		    scratch[i].Reset(MountainParams::BASE_TRIANGLES[i]);
+		else
+		    scratch[i].Subdivide(grids[i], seed, LevelRange(l - 1));
+	    }
+	    double  finished = Now();
+	    if ( r == 0 || finished - start < seconds )
+		seconds = finished - start;
+	}
+	grids.swap(scratch);
+
+	uint64_t    samples = 0;
+	uint64_t    triangles = 0;
+	size_t	    bytes = 0;
+	for ( int i = 0 ; i < MountainParams::NUM_BASE_TRIANGLES ; i++ )
+	{
+	    samples += grids[i].NumSamples();
+	    triangles += GridTriangles(grids[i]);
+	    bytes += grids[i].MemoryBytes() + scratch[i].MemoryBytes();
+	}
+
+	printf("        {\n");
+	printf("          \"level\": %d,\n", l);
+	printf("          \"triangles\": %llu,\n", (unsigned long long)triangles);
+	printf("          \"samples\": %llu,\n", (unsigned long long)samples);
+	printf("          \"seconds\": %.6f,\n", seconds);
+	printf("          \"triangles_per_second\": %.0f,\n",
+	       seconds > 0.0 ? triangles / seconds : 0.0);
+	printf("          \"bytes\": %zu,\n", bytes);
+	printf("          \"bytes_per_triangle\": %.2f,\n",
+	       triangles ? (double)bytes / triangles : 0.0);
+	printf("          \"peak_rss_bytes\": %zu\n", PeakRSS());
+	printf("        }%s\n", l < max_level ? "," : "");
+	fflush(stdout);
+    }
+    printf("      ]\n    }");
+}
+
+
+static void
+Usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-levels n] [-backend mesh|grid|all] "
+		    "[-seed s] [-repeat r]\n", name);
+    exit(1);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    int		levels = 10;
+    const char	*backend = "all";
+    uint64_t	seed = 1;
+    int		repeat = 1;
+
+    for ( int i = 1 ; i < argc ; i++ )
+    {
+	if ( i + 1 >= argc )
+	    Usage(argv[0]);
+	if ( ! strcmp(argv[i], "-levels") )
+	    levels = atoi(argv[++i]);
+	else if ( ! strcmp(argv[i], "-backend") )
+	    backend = argv[++i];
+	else if ( ! strcmp(argv[i], "-seed") )
+	    seed = strtoull(argv[++i], NULL, 0);
+	else if ( ! strcmp(argv[i], "-repeat") )
+	    repeat = atoi(argv[++i]);
+	else
+	    Usage(argv[0]);
+    }
+
+    bool    mesh = ! strcmp(backend, "mesh") || ! strcmp(backend, "all");
+    bool    grid = ! strcmp(backend, "grid") || ! strcmp(backend, "all");
+    if ( ( ! mesh && ! grid ) || levels < 0 || repeat < 1
+	 || levels > ( mesh ? MAX_MESH_LEVEL : MAX_GRID_LEVEL ) )
+	Usage(argv[0]);
+
+    printf("{\n");
+    printf("  \"seed\": %llu,\n", (unsigned long long)seed);
+    printf("  \"threads\": %d,\n", NumThreads());
+    printf("  \"repeat\": %d,\n", repeat);
+    printf("  \"base_range\": %g,\n", MountainParams::BASE_RANGE);
+    printf("  \"range_ratio\": %g,\n", MountainParams::RANGE_RATIO);
+    printf("  \"backends\": [\n");
+    if ( grid )
+	BenchmarkGrid(levels, seed, repeat);
+    if ( grid && mesh )
+	printf(",\n");
+    if ( mesh )
+	BenchmarkMesh(levels, seed, repeat);
+    printf("\n  ]\n}\n");
+
+    return 0;
+}
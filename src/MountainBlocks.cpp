@@ -0,0 +1,310 @@
+/*
+ * MountainBlocks.cpp: Mountain grids generated and stored in blocks.
+ *
+ * Within a block, samples are numbered by their steps (i, j) from its right
+ * angle, as in MountainTile, and the heights for detail d are the block's
+ * samples at every 2^d'th step, which is the block as it was d levels
+ * before the last.
+ */
+
+
+#include "MountainBlocks.h"
+#include "MountainTiles.h"
+#include "MountainCache.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const char MountainBlocks::MAGIC[8] = { 'M', 'T', 'N', 'B', 'L', 'O', 'C', 'K' };
+const uint32_t MountainBlocks::VERSION = 1;
+
+// The heights start on a page boundary, so blocks map in whole pages.
+static const uint64_t	HEIGHT_ALIGNMENT = 4096;
+
+
+// Samples in a triangle with steps lattice steps along a leg.
+static uint64_t
+NumSamples(uint64_t steps)
+{
+    return ( steps + 1 ) * ( steps + 2 ) / 2;
+}
+
+
+std::string
+MountainBlocks::FileName(uint64_t key)
+{
+    char    name[64];
+    snprintf(name, sizeof(name), "/mountain-%016llx.blocks", (unsigned long long)key);
+    return MountainCache::Directory() + name;
+}
+
+
+bool
+MountainBlocks::Generate(const char *filename, uint64_t key, const float base[][3][3],
+			 int num_base, int level, int block_level, uint64_t seed,
+			 const std::vector<float> &ranges)
+{
+    // The grids at the block level hold the corners of every block.
+    std::vector<MountainGrid>	coarse(num_base), scratch(num_base);
+    for ( int g = 0 ; g < num_base ; g++ )
+	coarse[g].Reset(base[g]);
+    for ( int l = 0 ; l < block_level ; l++ )
+    {
+	for ( int g = 0 ; g < num_base ; g++ )
+	    scratch[g].Subdivide(coarse[g], seed, ranges[l]);
+	coarse.swap(scratch);
+    }
+    std::vector<MountainGrid>().swap(scratch);
+
+    // One tile per lattice triangle gives the blocks, in tile order, with
+    // their neighbors.
+    MountainTiles   layout;
+    layout.Build(coarse, block_level);
+
+    Header  h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(h.magic));
+    h.version = VERSION;
+    h.record_size = sizeof(Record);
+    h.key = key;
+    h.level = level;
+    h.block_level = block_level;
+    h.num_grids = num_base;
+    h.num_blocks = (uint32_t)layout.NumTiles();
+    h.block_steps = 1u << ( level - block_level );
+    h.steps = h.block_steps << block_level;
+    h.corner_offset = sizeof(Header);
+    h.record_offset = h.corner_offset + num_base * sizeof(base[0]);
+    h.height_offset = h.record_offset + (uint64_t)h.num_blocks * sizeof(Record);
+    h.height_offset = ( h.height_offset + HEIGHT_ALIGNMENT - 1 )
+		      / HEIGHT_ALIGNMENT * HEIGHT_ALIGNMENT;
+    for ( uint32_t steps = 1 ; steps <= h.block_steps ; steps *= 2 )
+	h.block_bytes += NumSamples(steps) * sizeof(float);
+    h.file_size = h.height_offset + h.num_blocks * h.block_bytes;
+
+    // Written under a temporary name and renamed into place, so a reader
+    // never maps a half-written file. The records are only known once the
+    // blocks are made, so they are written last, over zeros.
+    std::string	temp = std::string(filename) + ".tmp";
+    FILE    *f = fopen(temp.c_str(), "wb");
+    if ( ! f )
+	return false;
+
+    std::vector<Record>	records(h.num_blocks);
+    memset(records.data(), 0, records.size() * sizeof(Record));
+    std::vector<char>	padding(h.height_offset - h.record_offset
+				- records.size() * sizeof(Record), 0);
+    bool    ok = fwrite(&h, sizeof(h), 1, f) == 1
+		 && fwrite(base, sizeof(base[0]), num_base, f) == (size_t)num_base
+		 && fwrite(records.data(), sizeof(Record), records.size(), f)
+		    == records.size()
+		 && fwrite(padding.data(), 1, padding.size(), f) == padding.size();
+
+    MountainGrid    block, next;
+    for ( uint32_t b = 0 ; ok && b < h.num_blocks ; b++ )
+    {
+	const MountainTile  &tile = layout.Tile(b);
+	const MountainGrid  &grid = coarse[tile.grid];
+
+	// The first corner, the second, then the right angle.
+	int	offsets[3][2] = { { tile.sign, 0 }, { 0, tile.sign }, { 0, 0 } };
+	float	corners[3][3];
+	for ( int c = 0 ; c < 3 ; c++ )
+	{
+	    uint32_t	i = tile.origin[0] + offsets[c][0];
+	    uint32_t	j = tile.origin[1] + offsets[c][1];
+	    corners[c][0] = grid.Coordinate(0, i, j);
+	    corners[c][1] = grid.Coordinate(1, i, j);
+	    corners[c][2] = grid.Height(i, j);
+	}
+
+	block.Reset(corners, block_level);
+	ok = fwrite(block.Heights(), sizeof(float), block.NumSamples(), f)
+	     == block.NumSamples();
+	for ( int l = block_level ; ok && l < level ; l++ )
+	{
+	    next.Subdivide(block, seed, ranges[l]);
+	    std::swap(block, next);
+	    ok = fwrite(block.Heights(), sizeof(float), block.NumSamples(), f)
+		 == block.NumSamples();
+	}
+
+	// The block is its own tile, with its corner at the origin.
+	MountainTile	measured;
+	measured.grid = 0;
+	measured.origin[0] = measured.origin[1] = 0;
+	measured.sign = 1;
+	measured.steps = h.block_steps;
+	MountainTiles::Measure(block, measured);
+
+	Record	&r = records[b];
+	r.grid = tile.grid;
+	r.origin[0] = tile.origin[0] * h.block_steps;
+	r.origin[1] = tile.origin[1] * h.block_steps;
+	r.sign = tile.sign;
+	memcpy(r.neighbor, tile.neighbor, sizeof(r.neighbor));
+	r.empty = measured.empty;
+	memcpy(r.bounds, measured.bounds, sizeof(r.bounds));
+	for ( size_t d = 0 ; d < measured.error.size() ; d++ )
+	    r.error[d] = measured.error[d];
+    }
+
+    if ( ok )
+	ok = fseek(f, (long)h.record_offset, SEEK_SET) == 0
+	     && fwrite(records.data(), sizeof(Record), records.size(), f)
+		== records.size();
+    if ( fclose(f) != 0 )
+	ok = false;
+    if ( ok && rename(temp.c_str(), filename) != 0 )
+	ok = false;
+    if ( ! ok )
+    {
+	fprintf(stderr, "MountainBlocks: couldn't write %s\n", filename);
+	remove(temp.c_str());
+    }
+    return ok;
+}
+
+
+bool
+MountainBlocks::Open(const char *filename, uint64_t key)
+{
+    struct stat	st;
+
+    Close();
+
+    fd = open(filename, O_RDONLY);
+    if ( fd < 0 )
+	return false;
+    if ( fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header) )
+    {
+	Close();
+	return false;
+    }
+
+    size = (size_t)st.st_size;
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if ( data == MAP_FAILED )
+    {
+	data = NULL;
+	Close();
+	return false;
+    }
+
+    // Anything that doesn't match exactly is treated as a miss, and the
+    // level gets generated again over it.
+    const Header    *h = (const Header *)data;
+    uint64_t	    block_bytes = 0;
+    int		    details = h->level - h->block_level;
+    if ( details >= 0 && details <= MAX_DETAILS )
+	for ( uint32_t steps = 1 ; steps <= ( 1u << details ) ; steps *= 2 )
+	    block_bytes += NumSamples(steps) * sizeof(float);
+    if ( memcmp(h->magic, MAGIC, sizeof(h->magic)) != 0 || h->version != VERSION
+	 || h->record_size != sizeof(Record) || h->key != key
+	 || h->file_size != size || details < 0 || details > MAX_DETAILS
+	 || h->block_steps != 1u << details
+	 || h->steps != h->block_steps << h->block_level
+	 || h->block_bytes != block_bytes
+	 || h->record_offset != h->corner_offset + h->num_grids * sizeof(float[3][3])
+	 || h->height_offset < h->record_offset + (uint64_t)h->num_blocks * sizeof(Record)
+	 || h->file_size != h->height_offset + h->num_blocks * h->block_bytes )
+    {
+	Close();
+	return false;
+    }
+
+    // Only the blocks and details that get drawn are read.
+    madvise(data, size, MADV_RANDOM);
+    // Marks it used, for MountainCache::Trim.
+    futimens(fd, NULL);
+
+    header = h;
+    num_details = details;
+    detail_offset.assign(details + 1, 0);
+    uint64_t	offset = 0;
+    for ( int d = details ; d >= 0 ; d-- )
+    {
+	detail_offset[d] = offset;
+	offset += NumSamples(h->block_steps >> d) * sizeof(float);
+    }
+
+    uint32_t	per_leg = 1u << h->block_level;
+    upright.assign((size_t)h->num_grids * per_leg * per_leg, -1);
+    turned.assign(upright.size(), -1);
+    for ( uint32_t b = 0 ; b < h->num_blocks ; b++ )
+    {
+	const Record	&r = Block(b);
+	uint32_t	a = r.origin[0] / h->block_steps;
+	uint32_t	c = r.origin[1] / h->block_steps;
+	if ( r.sign > 0 )
+	    upright[( r.grid * per_leg + c ) * per_leg + a] = (int)b;
+	else
+	    turned[( r.grid * per_leg + c - 1 ) * per_leg + a - 1] = (int)b;
+    }
+    return true;
+}
+
+
+void
+MountainBlocks::Close(void)
+{
+    if ( data )
+	munmap(data, size);
+    if ( fd >= 0 )
+	close(fd);
+    fd = -1;
+    data = NULL;
+    size = 0;
+    header = NULL;
+}
+
+
+float
+MountainBlocks::Height(int grid, uint32_t i, uint32_t j) const
+{
+    const uint32_t  s = header->block_steps;
+    const uint32_t  per_leg = 1u << header->block_level;
+    uint32_t	    a = i / s, b = j / s;
+    uint32_t	    li = i % s, lj = j % s;
+
+    // Samples on the far edge of the grid that start a row or column of
+    // blocks belong to the block before.
+    if ( a + b >= per_leg )
+    {
+	if ( a > 0 )
+	{
+	    a--;
+	    li += s;
+	}
+	else
+	{
+	    b--;
+	    lj += s;
+	}
+    }
+
+    int	block;
+    if ( li + lj <= s )
+	block = upright[( grid * per_leg + b ) * per_leg + a];
+    else
+    {
+	block = turned[( grid * per_leg + b ) * per_leg + a];
+	li = s - li;
+	lj = s - lj;
+    }
+
+    int	d = 0;
+    while ( d < num_details && ( ( li | lj ) >> d & 1 ) == 0 )
+	d++;
+    uint32_t	m = s >> d;
+    li >>= d;
+    lj >>= d;
+
+    const float	*heights = (const float *)( (const char *)data + header->height_offset
+					    + block * header->block_bytes
+					    + detail_offset[d] );
+    return heights[(size_t)lj * ( m + 1 ) - (size_t)lj * ( lj - 1 ) / 2 + li];
+}
@@ -0,0 +1,143 @@
+/*
+ * MountainBlocks.h: Header file for mountain grids too deep to hold in
+ * memory, generated a block at a time into a file and paged back in.
+ *
+ */
+
+
+#ifndef _MOUNTAINBLOCKS_H_
+#define _MOUNTAINBLOCKS_H_
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+#include "MountainGrid.h"
+
+// The grids of a level are cut into blocks, one per lattice triangle of a
+// much coarser block level. A midpoint on the edge of a block depends only
+// on the ends of that edge, so every block can be subdivided on its own from
+// its three corners, and blocks that share an edge come out with the same
+// samples along it. Generating a level only ever holds one block in memory.
+//
+// The file holds a header, the base triangles, a record per block, then the
+// heights of each block once for every level it went through, coarsest
+// first, rows as in MountainGrid. A tile drawn at some detail reads only the
+// level it needs, so the mapping pages in about as much as is drawn. Blocks
+// are in the order MountainTiles cuts them, and their records carry what it
+// would measure, so the blocks can be drawn as its tiles without reading any
+// heights until they are extracted.
+class MountainBlocks {
+  public:
+    static const int	MAX_DETAILS = 15;   // Most levels within a block.
+
+    struct Record {
+	int32_t	    grid;
+	uint32_t    origin[2];	    // As in MountainTile, on the full lattice.
+	int32_t	    sign;
+	int32_t	    neighbor[3];
+	uint32_t    empty;
+	float	    bounds[2][3];
+	float	    error[MAX_DETAILS + 1];
+    };
+
+    // One grid as a lattice, for MountainGridSample.
+    class Lattice {
+      private:
+	const MountainBlocks	*blocks;
+	int			grid;
+
+      public:
+	Lattice(const MountainBlocks *b, int g) { blocks = b; grid = g; };
+
+	uint32_t    Steps(void) const { return blocks->header->steps; };
+	float	    Coordinate(int axis, uint32_t i, uint32_t j) const
+			{ return MountainGrid::Coordinate(blocks->Corners(grid),
+							  Steps(), axis, i, j); };
+	float	    Height(uint32_t i, uint32_t j) const
+			{ return blocks->Height(grid, i, j); };
+	void	    Sample(uint32_t i, uint32_t j, uint32_t stride,
+			   MountainVertex &v) const
+			{ MountainGridSample(*this, i, j, stride, v); };
+    };
+
+  private:
+    struct Header {
+	char	    magic[8];
+	uint32_t    version;
+	uint32_t    record_size;    // sizeof(Record), as a layout check.
+	uint64_t    key;
+	int32_t	    level;
+	int32_t	    block_level;
+	uint32_t    num_grids;
+	uint32_t    num_blocks;
+	uint32_t    steps;	    // Lattice steps along a leg of a grid.
+	uint32_t    block_steps;    // And of a block.
+	uint64_t    corner_offset;  // Byte offsets of the parts of the file.
+	uint64_t    record_offset;
+	uint64_t    height_offset;
+	uint64_t    block_bytes;    // Of the heights of one block.
+	uint64_t    file_size;
+    };
+
+    static const char	    MAGIC[8];
+    static const uint32_t   VERSION;
+
+    int		    fd;	    // The open file, or -1.
+    void	    *data;  // Its mapping.
+    size_t	    size;
+    const Header    *header;
+    int		    num_details;
+    std::vector<uint64_t>   detail_offset;  // Of each detail within a block.
+    std::vector<int>	    upright;	    // Block of each upright and turned
+    std::vector<int>	    turned;	    // lattice triangle, per grid.
+
+    // Copy is not allowed; each object owns its mapping.
+    MountainBlocks(const MountainBlocks &);
+    MountainBlocks &operator=(const MountainBlocks &);
+
+    const float	(*Corners(int grid) const)[3]
+		{ return (const float (*)[3])( (const char *)data + header->corner_offset )
+			 + grid * 3; };
+
+  public:
+    MountainBlocks(void) { fd = -1; data = NULL; size = 0; header = NULL;
+			   num_details = 0; };
+    ~MountainBlocks(void) { Close(); };
+
+    // The name of the file a level with this key is saved in. The key is
+    // the level's MountainCache key, and the file sits with the level files
+    // in MountainCache::Directory(), sharing their size cap.
+    static std::string	FileName(uint64_t key);
+
+    // Generates level of the grids on the num_base base triangles, in
+    // blocks of block_level, displacing level l by up to +- ranges[l], and
+    // writes them to filename. The file appears complete or not at all.
+    // Returns false on failure.
+    static bool	Generate(const char *filename, uint64_t key, const float base[][3][3],
+			 int num_base, int level, int block_level, uint64_t seed,
+			 const std::vector<float> &ranges);
+
+    // Maps filename, if it exists and holds the level with this key.
+    // Returns false, leaving nothing open, otherwise.
+    bool    Open(const char *filename, uint64_t key);
+    void    Close(void);
+    bool    IsOpen(void) const { return header != NULL; };
+
+    uint64_t	    Key(void) const { return header->key; };
+    int		    Level(void) const { return header->level; };
+    int		    BlockLevel(void) const { return header->block_level; };
+    uint32_t	    BlockSteps(void) const { return header->block_steps; };
+    uint32_t	    NumBlocks(void) const { return header->num_blocks; };
+    const Record    &Block(uint32_t b) const
+		    { return ( (const Record *)( (const char *)data
+						 + header->record_offset ) )[b]; };
+    Lattice	    Grid(int grid) const { return Lattice(this, grid); };
+
+    // The height of sample (i, j) of a grid, read from the coarsest level
+    // of whichever block holds it that has it.
+    float   Height(int grid, uint32_t i, uint32_t j) const;
+};
+
+
+#endif
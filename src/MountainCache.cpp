@@ -0,0 +1,338 @@
+/*
+ * MountainCache.cpp: Binary files of subdivided mountain levels.
+ *
+ */
+
+
+#include "MountainCache.h"
+#include "MountainRandom.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const char MountainCache::MAGIC[8] = { 'M', 'T', 'N', 'L', 'E', 'V', 'E', 'L' };
+const uint32_t MountainCache::VERSION = 5;
+
+// Vertices written per chunk while saving.
+static const uint32_t	SAVE_CHUNK_VERTICES = 65536;
+// A temporary file this old belongs to a write that died with its program.
+static const time_t	STALE_TEMP_SECONDS = 3600;
+
+
+// Folds the bits of a float into a running hash.
+static uint64_t
+HashFloat(uint64_t h, float f)
+{
+    uint32_t	bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return MountainRandom::Mix(h ^ bits);
+}
+
+
+uint64_t
+MountainCache::Key(uint64_t seed, const float base[][3][3], int num_base,
+		   int level, float base_range, float range_ratio, uint64_t occluders)
+{
+    uint64_t	h = MountainRandom::Mix(seed);
+
+    for ( int i = 0 ; i < num_base ; i++ )
+	for ( int j = 0 ; j < 3 ; j++ )
+	    for ( int k = 0 ; k < 3 ; k++ )
+		h = HashFloat(h, base[i][j][k]);
+    h = MountainRandom::Mix(h ^ (uint64_t)level);
+    h = HashFloat(h, base_range);
+    h = HashFloat(h, range_ratio);
+    h = MountainRandom::Mix(h ^ occluders);
+    return MountainRandom::Mix(h ^ VERSION);
+}
+
+
+std::string
+MountainCache::FileName(uint64_t key)
+{
+    char    name[64];
+    snprintf(name, sizeof(name), "/mountain-%016llx.cache", (unsigned long long)key);
+    return Directory() + name;
+}
+
+
+// Makes dir and any of its parents that are missing. Returns whether it is
+// a directory now.
+static bool
+MakeDirectory(const std::string &dir)
+{
+    struct stat	st;
+
+    for ( size_t i = 1 ; i < dir.size() ; i++ )
+	if ( dir[i] == '/' )
+	    mkdir(dir.substr(0, i).c_str(), 0755);
+    mkdir(dir.c_str(), 0755);
+    return stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+
+const std::string &
+MountainCache::Directory(void)
+{
+    static const std::string	dir = [](void) {
+	const char  *env;
+	std::string d;
+	if ( ( env = getenv("MOUNTAIN_CACHE") ) && *env )
+	    d = env;
+	else if ( ( env = getenv("XDG_CACHE_HOME") ) && *env )
+	    d = std::string(env) + "/mountain";
+	else if ( ( env = getenv("HOME") ) && *env )
+	    d = std::string(env) + "/.cache/mountain";
+	if ( d.empty() || ! MakeDirectory(d) )
+	{
+	    fprintf(stderr, "MountainCache: no cache directory, using the current one\n");
+	    d = ".";
+	}
+	return d;
+    }();
+    return dir;
+}
+
+
+void
+MountainCache::Trim(uint64_t max_bytes, const char *keep)
+{
+    struct File {
+	std::string name;
+	time_t	    used;
+	uint64_t    bytes;
+	bool	    operator<(const File &f) const { return used < f.used; };
+    };
+    std::vector<File>	files;
+    uint64_t		total = 0;
+    time_t		now = time(NULL);
+
+    DIR	*dir = opendir(Directory().c_str());
+    if ( ! dir )
+	return;
+    for ( struct dirent *e = readdir(dir) ; e ; e = readdir(dir) )
+    {
+	struct stat st;
+	File	    f;
+	size_t	    len = strlen(e->d_name);
+	if ( strncmp(e->d_name, "mountain-", 9) != 0 )
+	    continue;
+	f.name = Directory() + "/" + e->d_name;
+	if ( stat(f.name.c_str(), &st) != 0 || ! S_ISREG(st.st_mode) )
+	    continue;
+	if ( len > 4 && ! strcmp(e->d_name + len - 4, ".tmp") )
+	{
+	    if ( now - st.st_mtime > STALE_TEMP_SECONDS )
+		remove(f.name.c_str());
+	    continue;
+	}
+	f.used = st.st_mtime;
+	f.bytes = (uint64_t)st.st_size;
+	total += f.bytes;
+	files.push_back(f);
+    }
+    closedir(dir);
+
+    // A file still mapped somewhere stays readable there until it is closed.
+    std::sort(files.begin(), files.end());
+    for ( size_t i = 0 ; i < files.size() && total > max_bytes ; i++ )
+    {
+	if ( keep && files[i].name == keep )
+	    continue;
+	if ( remove(files[i].name.c_str()) == 0 )
+	    total -= files[i].bytes;
+    }
+}
+
+
+bool
+MountainCache::Save(const char *filename, uint64_t key, const MountainMesh &mesh)
+{
+    Header  h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(h.magic));
+    h.version = VERSION;
+    h.vertex_size = sizeof(MountainVertex);
+    h.key = key;
+    h.num_vertices = mesh.NumVertices();
+    h.num_indices = (uint32_t)mesh.indices.size();
+    h.num_twins = mesh.HasTwins() ? h.num_indices : 0;
+    h.vertex_offset = sizeof(Header);
+    h.index_offset = h.vertex_offset + (uint64_t)h.num_vertices * sizeof(MountainVertex);
+    h.twin_offset = h.index_offset + (uint64_t)h.num_indices * sizeof(uint32_t);
+    h.file_size = h.twin_offset + (uint64_t)h.num_twins * sizeof(uint32_t);
+
+    // Written under a temporary name and renamed into place, so a reader
+    // never maps a half-written file.
+    std::string	temp = std::string(filename) + ".tmp";
+    FILE    *f = fopen(temp.c_str(), "wb");
+    if ( ! f )
+	return false;
+
+    bool    ok = fwrite(&h, sizeof(h), 1, f) == 1;
+
+    // The mesh stores its arrays separately, so interleave a chunk at a time.
+    std::vector<MountainVertex>	chunk;
+    for ( uint32_t first = 0 ; ok && first < h.num_vertices ;
+	  first += SAVE_CHUNK_VERTICES )
+    {
+	uint32_t    count = std::min(SAVE_CHUNK_VERTICES, h.num_vertices - first);
+	chunk.resize(count);
+	for ( uint32_t i = 0 ; i < count ; i++ )
+	{
+	    MountainVertex  &v = chunk[i];
+	    uint32_t	    s = first + i;
+	    v.position[0] = mesh.x[s];
+	    v.position[1] = mesh.y[s];
+	    v.position[2] = mesh.z[s];
+	    v.normal[0] = mesh.nx[s];
+	    v.normal[1] = mesh.ny[s];
+	    v.normal[2] = mesh.nz[s];
+	    memcpy(v.color, &mesh.color[s*4], 4);
+	}
+	ok = fwrite(chunk.data(), sizeof(MountainVertex), count, f) == count;
+    }
+    if ( ok && h.num_indices )
+	ok = fwrite(mesh.indices.data(), sizeof(uint32_t), h.num_indices, f)
+	     == h.num_indices;
+    if ( ok && h.num_twins )
+	ok = fwrite(mesh.twins.data(), sizeof(uint32_t), h.num_twins, f)
+	     == h.num_twins;
+
+    if ( fclose(f) != 0 )
+	ok = false;
+    if ( ok && rename(temp.c_str(), filename) != 0 )
+	ok = false;
+    if ( ! ok )
+    {
+	fprintf(stderr, "MountainCache: couldn't write %s\n", filename);
+	remove(temp.c_str());
+    }
+    return ok;
+}
+
+
+bool
+MountainCache::Open(const char *filename, uint64_t key)
+{
+    struct stat	st;
+
+    Close();
+
+    fd = open(filename, O_RDONLY);
+    if ( fd < 0 )
+	return false;
+    if ( fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header) )
+    {
+	Close();
+	return false;
+    }
+
+    size = (size_t)st.st_size;
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if ( data == MAP_FAILED )
+    {
+	data = NULL;
+	Close();
+	return false;
+    }
+
+    // Anything that doesn't match exactly is treated as a miss, and the
+    // level gets rebuilt and saved over it.
+    const Header    *h = (const Header *)data;
+    if ( memcmp(h->magic, MAGIC, sizeof(h->magic)) != 0 || h->version != VERSION
+	 || h->vertex_size != sizeof(MountainVertex) || h->key != key
+	 || h->file_size != size
+	 || h->index_offset != h->vertex_offset
+			      + (uint64_t)h->num_vertices * sizeof(MountainVertex)
+	 || h->twin_offset != h->index_offset
+			      + (uint64_t)h->num_indices * sizeof(uint32_t)
+	 || ( h->num_twins != 0 && h->num_twins != h->num_indices )
+	 || h->file_size != h->twin_offset
+			    + (uint64_t)h->num_twins * sizeof(uint32_t) )
+    {
+	Close();
+	return false;
+    }
+
+    // The whole file is about to be read, by the upload if nothing else.
+    madvise(data, size, MADV_WILLNEED);
+    // Marks it used, for Trim.
+    futimens(fd, NULL);
+
+    header = h;
+    return true;
+}
+
+
+void
+MountainCache::Close(void)
+{
+    if ( data )
+	munmap(data, size);
+    if ( fd >= 0 )
+	close(fd);
+    fd = -1;
+    data = NULL;
+    size = 0;
+    header = NULL;
+}
+
+
+const MountainVertex *
+MountainCache::Vertices(void) const
+{
+    return (const MountainVertex *)( (const char *)data + header->vertex_offset );
+}
+
+
+const uint32_t *
+MountainCache::Indices(void) const
+{
+    return (const uint32_t *)( (const char *)data + header->index_offset );
+}
+
+
+const uint32_t *
+MountainCache::Twins(void) const
+{
+    return (const uint32_t *)( (const char *)data + header->twin_offset );
+}
+
+
+void
+MountainCache::Load(MountainMesh &mesh) const
+{
+    const MountainVertex    *v = Vertices();
+    uint32_t		    n = NumVertices();
+
+    mesh.x.resize(n);
+    mesh.y.resize(n);
+    mesh.z.resize(n);
+    mesh.nx.resize(n);
+    mesh.ny.resize(n);
+    mesh.nz.resize(n);
+    mesh.color.resize(n * 4);
+    mesh.occlusion.resize(n);
+    for ( uint32_t i = 0 ; i < n ; i++ )
+    {
+	mesh.x[i] = v[i].position[0];
+	mesh.y[i] = v[i].position[1];
+	mesh.z[i] = v[i].position[2];
+	mesh.nx[i] = v[i].normal[0];
+	mesh.ny[i] = v[i].normal[1];
+	mesh.nz[i] = v[i].normal[2];
+	memcpy(&mesh.color[i*4], v[i].color, 4);
+	mesh.occlusion[i] = v[i].color[3];
+    }
+    mesh.indices.assign(Indices(), Indices() + NumIndices());
+    mesh.twins.assign(Twins(), Twins() + header->num_twins);
+}
@@ -0,0 +1,103 @@
+/*
+ * MountainCache.h: Header file for saving subdivided mountain levels to disk
+ * and mapping them back in.
+ *
+ */
+
+
+#ifndef _MOUNTAINCACHE_H_
+#define _MOUNTAINCACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include "MountainMesh.h"
+
+// A cache file holds one level: a header, the vertices in the interleaved
+// layout the vertex buffer uses, the triangle indices, then the twins of
+// the half-edges, if the mesh had them. The first two arrays can be handed
+// to OpenGL straight from the mapped file. Files are written in the
+// machine's byte order and rejected anywhere else.
+//
+// A file is named and checked by a key hashed from everything the level
+// depends on: the seed, the base triangles, the level, the displacement
+// range and its decay, and what its occlusion was baked against. VERSION
+// must be bumped whenever the way a level is built, or the file layout,
+// changes.
+//
+// Files live in a directory of their own, and grow with every seed and
+// level looked at, so Trim is there to keep them to a budget. Opening a
+// file marks it used, and the files used longest ago go first.
+class MountainCache {
+  private:
+    struct Header {
+	char	    magic[8];
+	uint32_t    version;
+	uint32_t    vertex_size;    // sizeof(MountainVertex), as a layout check.
+	uint64_t    key;
+	uint32_t    num_vertices;
+	uint32_t    num_indices;
+	uint32_t    num_twins;	    // num_indices, or 0 without twins.
+	uint32_t    unused;
+	uint64_t    vertex_offset;  // Byte offsets of the arrays in the file.
+	uint64_t    index_offset;
+	uint64_t    twin_offset;
+	uint64_t    file_size;
+    };
+
+    static const char	    MAGIC[8];
+    static const uint32_t   VERSION;
+
+    int		    fd;	    // The open file, or -1.
+    void	    *data;  // Its mapping.
+    size_t	    size;
+    const Header    *header;
+
+    // Copy is not allowed; each object owns its mapping.
+    MountainCache(const MountainCache &);
+    MountainCache &operator=(const MountainCache &);
+
+  public:
+    MountainCache(void) { fd = -1; data = NULL; size = 0; header = NULL; };
+    ~MountainCache(void) { Close(); };
+
+    // The key of a level, and the name of the file it is saved in.
+    // occluders is a hash of the triangles standing on the mountain.
+    static uint64_t	Key(uint64_t seed, const float base[][3][3], int num_base,
+			    int level, float base_range, float range_ratio,
+			    uint64_t occluders);
+    static std::string	FileName(uint64_t key);
+
+    // The directory level files are kept in: $MOUNTAIN_CACHE if that is
+    // set, otherwise mountain in the user's cache directory. Made the first
+    // time it is asked for, and the current directory if that fails.
+    static const std::string	&Directory(void);
+
+    // Deletes the level files in Directory() used longest ago until the
+    // rest take at most max_bytes, sparing keep. Blocks files count as
+    // well. Temporary files are left to the writes making them, unless
+    // they are old enough that the write must have died.
+    static void	Trim(uint64_t max_bytes, const char *keep);
+
+    // Writes a level, with its shading, to filename. The file appears
+    // complete or not at all. Returns false on failure.
+    static bool	Save(const char *filename, uint64_t key, const MountainMesh &mesh);
+
+    // Maps filename, if it exists and holds the level with this key.
+    // Returns false, leaving nothing open, otherwise.
+    bool    Open(const char *filename, uint64_t key);
+    void    Close(void);
+    bool    IsOpen(void) const { return header != NULL; };
+
+    uint32_t		    NumVertices(void) const { return header->num_vertices; };
+    uint32_t		    NumIndices(void) const { return header->num_indices; };
+    const MountainVertex    *Vertices(void) const;
+    const uint32_t	    *Indices(void) const;
+    const uint32_t	    *Twins(void) const;
+
+    // Copies the mapped level into mesh, its occlusion included.
+    void    Load(MountainMesh &mesh) const;
+};
+
+
+#endif
@@ -0,0 +1,584 @@
+/*
+ * MountainDecimator.cpp: Quadric error metric simplification of mountain
+ * levels.
+ *
+ * Follows Garland and Heckbert, "Surface Simplification Using Quadric Error
+ * Metrics", with the border constraint planes from the same paper. Stale
+ * queue entries are recognised by vertex stamps, as in MountainLOD.
+ */
+
+
+#include "MountainDecimator.h"
+#include <math.h>
+#include <algorithm>
+
+const float MountainDecimator::BOUNDARY_WEIGHT = 100.0f;
+const float MountainDecimator::MIN_NORMAL_COS = 0.2f;
+
+// Vertex flags.
+static const uint8_t	PINNED = 1;	// Next to the ground. Never moves.
+static const uint8_t	BORDER = 2;	// On the border of the mesh.
+static const uint8_t	REMOVED = 4;	// Collapsed into another vertex.
+
+// Sine of the angle between border edges beyond which their vertex is a
+// corner. Sides of the outline are straight, up to rounding.
+static const float	MAX_SIDE_TURN = 1e-4f;
+
+// Marks a vertex that hasn't been given an output number.
+static const uint32_t	UNMAPPED = 0xFFFFFFFFu;
+
+
+static void
+Cross(const double a[3], const double b[3], double out[3])
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+
+// Adds weight times the squared distance to the plane n.p + d = 0, where n
+// has unit length.
+void
+MountainDecimator::AddPlane(Quadric &dest, const double n[3], double d,
+			    double weight)
+{
+    double  *q = dest.q;
+    q[0] += weight * n[0] * n[0];
+    q[1] += weight * n[0] * n[1];
+    q[2] += weight * n[0] * n[2];
+    q[3] += weight * n[0] * d;
+    q[4] += weight * n[1] * n[1];
+    q[5] += weight * n[1] * n[2];
+    q[6] += weight * n[1] * d;
+    q[7] += weight * n[2] * n[2];
+    q[8] += weight * n[2] * d;
+    q[9] += weight * d * d;
+}
+
+
+double
+MountainDecimator::Evaluate(const Quadric &quadric, const float p[3]) const
+{
+    const double    *q = quadric.q;
+    double	    px = p[0], py = p[1], pz = p[2];
+
+    return q[0] * px * px + 2 * q[1] * px * py + 2 * q[2] * px * pz
+	 + 2 * q[3] * px + q[4] * py * py + 2 * q[5] * py * pz + 2 * q[6] * py
+	 + q[7] * pz * pz + 2 * q[8] * pz + q[9];
+}
+
+
+// Works out where the collapse of edge a-b should put the surviving vertex,
+// and what it costs. Returns false if the edge can't collapse at all.
+bool
+MountainDecimator::Consider(uint32_t a, uint32_t b, Candidate &c) const
+{
+    if ( ( flags[a] & PINNED ) && ( flags[b] & PINNED ) )
+	return false;
+
+    Quadric q;
+    for ( int i = 0 ; i < 10 ; i++ )
+	q.q[i] = quadrics[a].q[i] + quadrics[b].q[i];
+    q.area = quadrics[a].area + quadrics[b].area;
+
+    // A pinned vertex stays put and the other one comes to it, and so does
+    // a border vertex joined to one inside.
+    bool    border_a = ( flags[a] & BORDER ) != 0, border_b = ( flags[b] & BORDER ) != 0;
+    if ( flags[a] & PINNED )
+	c.keep = a;
+    else if ( flags[b] & PINNED )
+	c.keep = b;
+    else
+	c.keep = border_b && ! border_a ? b : a;
+    c.remove = c.keep == a ? b : a;
+
+    // Pulling a border vertex inside would move the outline.
+    if ( ( flags[c.remove] & BORDER ) && ! ( flags[c.keep] & BORDER ) )
+	return false;
+
+    float   pa[3] = { x[a], y[a], z[a] };
+    float   pb[3] = { x[b], y[b], z[b] };
+    float   mid[3] = { ( pa[0] + pb[0] ) * 0.5f, ( pa[1] + pb[1] ) * 0.5f,
+		       ( pa[2] + pb[2] ) * 0.5f };
+    float   *best = NULL;
+    double  cost = 0.0;
+
+    if ( ( flags[c.keep] & PINNED ) || border_a != border_b )
+    {
+	best = c.keep == a ? pa : pb;
+	cost = Evaluate(q, best);
+    }
+    else if ( border_a )
+    {
+	// Both on the border, so along the one straight side of the outline
+	// they share, corners being pinned: the cheapest point of the edge,
+	// which the quadric is a parabola along.
+	double	e[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+	double	f0 = Evaluate(q, pa), f1 = Evaluate(q, pb), fm = Evaluate(q, mid);
+	double	curve = 2.0 * ( f0 + f1 - 2.0 * fm );
+	float	*choices[4] = { pa, pb, mid, NULL };
+	if ( curve > 0.0 )
+	{
+	    double  t = std::min(std::max(( 3.0 * f0 - 4.0 * fm + f1 ) / ( 2.0 * curve ), 0.0), 1.0);
+	    for ( int k = 0 ; k < 3 ; k++ )
+		c.position[k] = pa[k] + (float)( t * e[k] );
+	    choices[3] = c.position;
+	}
+	for ( int i = 0 ; i < 4 && choices[i] ; i++ )
+	{
+	    double  f = Evaluate(q, choices[i]);
+	    if ( ! best || f < cost )
+	    {
+		best = choices[i];
+		cost = f;
+	    }
+	}
+    }
+    else
+    {
+	// The point that minimises the quadric, if it is well defined, not
+	// far from the edge and not under the ground. Flat areas leave the
+	// system singular.
+	const double	*m = q.q;
+	double	det = m[0] * ( m[4] * m[7] - m[5] * m[5] )
+		    - m[1] * ( m[1] * m[7] - m[5] * m[2] )
+		    + m[2] * ( m[1] * m[5] - m[4] * m[2] );
+	double	scale = std::max(m[0], std::max(m[4], m[7]));
+	if ( fabs(det) > 1e-9 * scale * scale * scale )
+	{
+	    double  r[3] = { -m[3], -m[6], -m[8] };
+	    double  px = ( r[0] * ( m[4] * m[7] - m[5] * m[5] )
+			 - m[1] * ( r[1] * m[7] - m[5] * r[2] )
+			 + m[2] * ( r[1] * m[5] - m[4] * r[2] ) ) / det;
+	    double  py = ( m[0] * ( r[1] * m[7] - m[5] * r[2] )
+			 - r[0] * ( m[1] * m[7] - m[5] * m[2] )
+			 + m[2] * ( m[1] * r[2] - r[1] * m[2] ) ) / det;
+	    double  pz = ( m[0] * ( m[4] * r[2] - r[1] * m[5] )
+			 - m[1] * ( m[1] * r[2] - r[1] * m[2] )
+			 + r[0] * ( m[1] * m[5] - m[4] * m[2] ) ) / det;
+	    double  ex = pb[0] - pa[0], ey = pb[1] - pa[1], ez = pb[2] - pa[2];
+	    double  mx = px - ( pa[0] + pb[0] ) * 0.5;
+	    double  my = py - ( pa[1] + pb[1] ) * 0.5;
+	    double  mz = pz - ( pa[2] + pb[2] ) * 0.5;
+	    if ( pz >= 0.0 && mx * mx + my * my + mz * mz <= ex * ex + ey * ey + ez * ez )
+	    {
+		c.position[0] = (float)px;
+		c.position[1] = (float)py;
+		c.position[2] = (float)pz;
+		best = c.position;
+		cost = Evaluate(q, best);
+	    }
+	}
+
+	// Otherwise the cheapest of the two ends and the middle.
+	if ( ! best )
+	{
+	    float   *choices[3] = { pa, pb, mid };
+	    for ( int i = 0 ; i < 3 ; i++ )
+	    {
+		double	e = Evaluate(q, choices[i]);
+		if ( ! best || e < cost )
+		{
+		    best = choices[i];
+		    cost = e;
+		}
+	    }
+	}
+    }
+
+    if ( best != c.position )
+    {
+	c.position[0] = best[0];
+	c.position[1] = best[1];
+	c.position[2] = best[2];
+    }
+    c.error = (float)sqrt(std::max(cost, 0.0) / std::max(q.area, 1e-30));
+    return true;
+}
+
+
+void
+MountainDecimator::Push(uint32_t a, uint32_t b, float error)
+{
+    QueueEntry	e;
+    e.error = error;
+    e.a = a;
+    e.b = b;
+    e.stamp = stamp[a] + stamp[b];
+    heap.push_back(e);
+    std::push_heap(heap.begin(), heap.end(), HeapOrder());
+}
+
+
+// Evaluates every edge around v again.
+void
+MountainDecimator::PushNeighbors(uint32_t v)
+{
+    Candidate	c;
+
+    mark_value++;
+    mark[v] = mark_value;
+    for ( size_t i = 0 ; i < around[v].size() ; i++ )
+    {
+	const uint32_t	*t = &indices[around[v][i] * 3];
+	for ( int k = 0 ; k < 3 ; k++ )
+	{
+	    uint32_t	w = t[k];
+	    if ( mark[w] == mark_value )
+		continue;
+	    mark[w] = mark_value;
+	    if ( Consider(v, w, c) )
+		Push(v, w, c.error);
+	}
+    }
+}
+
+
+// Whether moving vertex moved to p turns any of its triangles that don't
+// also hold other too far, or squashes it flat.
+bool
+MountainDecimator::Flips(uint32_t moved, uint32_t other, const float p[3]) const
+{
+    for ( size_t i = 0 ; i < around[moved].size() ; i++ )
+    {
+	const uint32_t	*t = &indices[around[moved][i] * 3];
+	if ( t[0] == other || t[1] == other || t[2] == other )
+	    continue;
+
+	double	before[3][3], after[3][3];
+	for ( int k = 0 ; k < 3 ; k++ )
+	{
+	    before[k][0] = x[t[k]];
+	    before[k][1] = y[t[k]];
+	    before[k][2] = z[t[k]];
+	    after[k][0] = t[k] == moved ? p[0] : before[k][0];
+	    after[k][1] = t[k] == moved ? p[1] : before[k][1];
+	    after[k][2] = t[k] == moved ? p[2] : before[k][2];
+	}
+
+	double	e1[3], e2[3], n0[3], n1[3];
+	for ( int k = 0 ; k < 3 ; k++ )
+	{
+	    e1[k] = before[1][k] - before[0][k];
+	    e2[k] = before[2][k] - before[0][k];
+	}
+	Cross(e1, e2, n0);
+	for ( int k = 0 ; k < 3 ; k++ )
+	{
+	    e1[k] = after[1][k] - after[0][k];
+	    e2[k] = after[2][k] - after[0][k];
+	}
+	Cross(e1, e2, n1);
+
+	double	l0 = sqrt(n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]);
+	double	l1 = sqrt(n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]);
+	if ( l1 <= 1e-12 * std::max(l0, 1e-30)
+	     || n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] < MIN_NORMAL_COS * l0 * l1 )
+	    return true;
+    }
+    return false;
+}
+
+
+// Whether a candidate can still be collapsed without breaking the mesh.
+bool
+MountainDecimator::Collapsible(const Candidate &c)
+{
+    // The triangles on the edge, and the vertices next to both ends. Any
+    // vertex next to both that isn't across one of those triangles would
+    // end up on an edge shared by more than two triangles.
+    uint32_t	shared = 0, common = 0;
+
+    mark_value++;
+    for ( size_t i = 0 ; i < around[c.keep].size() ; i++ )
+    {
+	const uint32_t	*t = &indices[around[c.keep][i] * 3];
+	for ( int k = 0 ; k < 3 ; k++ )
+	    mark[t[k]] = mark_value;
+    }
+    mark_value++;
+    for ( size_t i = 0 ; i < around[c.remove].size() ; i++ )
+    {
+	const uint32_t	*t = &indices[around[c.remove][i] * 3];
+	if ( t[0] == c.keep || t[1] == c.keep || t[2] == c.keep )
+	    shared++;
+	for ( int k = 0 ; k < 3 ; k++ )
+	{
+	    uint32_t	w = t[k];
+	    if ( w != c.keep && w != c.remove && mark[w] == mark_value - 1 )
+	    {
+		mark[w] = mark_value;
+		common++;
+	    }
+	}
+    }
+    if ( shared == 0 || common != shared )
+	return false;
+
+    // Two border vertices joined across the inside would pinch the mesh.
+    if ( shared == 2 && ( flags[c.keep] & BORDER ) && ( flags[c.remove] & BORDER ) )
+	return false;
+
+    return ! Flips(c.keep, c.remove, c.position)
+	&& ! Flips(c.remove, c.keep, c.position);
+}
+
+
+void
+MountainDecimator::Collapse(const Candidate &c)
+{
+    std::vector<uint32_t>   &keep_around = around[c.keep];
+    std::vector<uint32_t>   &remove_around = around[c.remove];
+
+    for ( size_t i = 0 ; i < remove_around.size() ; i++ )
+    {
+	uint32_t    t = remove_around[i];
+	uint32_t    *v = &indices[t * 3];
+	if ( v[0] == c.keep || v[1] == c.keep || v[2] == c.keep )
+	{
+	    // Gone from the list of its third vertex too.
+	    dead[t] = true;
+	    for ( int k = 0 ; k < 3 ; k++ )
+	    {
+		if ( v[k] == c.keep || v[k] == c.remove )
+		    continue;
+		std::vector<uint32_t>	&other = around[v[k]];
+		other.erase(std::find(other.begin(), other.end(), t));
+	    }
+	    continue;
+	}
+	for ( int k = 0 ; k < 3 ; k++ )
+	    if ( v[k] == c.remove )
+		v[k] = c.keep;
+	keep_around.push_back(t);
+    }
+    remove_around.clear();
+
+    size_t  n = 0;
+    for ( size_t i = 0 ; i < keep_around.size() ; i++ )
+	if ( ! dead[keep_around[i]] )
+	    keep_around[n++] = keep_around[i];
+    keep_around.resize(n);
+
+    x[c.keep] = c.position[0];
+    y[c.keep] = c.position[1];
+    z[c.keep] = c.position[2];
+    for ( int i = 0 ; i < 10 ; i++ )
+	quadrics[c.keep].q[i] += quadrics[c.remove].q[i];
+    quadrics[c.keep].area += quadrics[c.remove].area;
+    flags[c.keep] |= flags[c.remove] & BORDER;
+    flags[c.remove] |= REMOVED;
+    stamp[c.keep]++;
+    stamp[c.remove]++;
+
+    PushNeighbors(c.keep);
+}
+
+
+void
+MountainDecimator::Decimate(const MountainMesh &in, MountainMesh &out,
+			    uint32_t target_triangles, float max_error)
+{
+    const uint32_t  num_vertices = in.NumVertices();
+    const uint32_t  num_triangles = in.NumTriangles();
+
+    x = in.x;
+    y = in.y;
+    z = in.z;
+    indices = in.indices;
+    dead.assign(num_triangles, false);
+    around.resize(num_vertices);
+    for ( uint32_t v = 0 ; v < num_vertices ; v++ )
+	around[v].clear();
+    for ( uint32_t i = 0 ; i < num_triangles * 3 ; i++ )
+	around[indices[i]].push_back(i / 3);
+    stamp.assign(num_vertices, 0);
+    mark.assign(num_vertices, 0);
+    mark_value = 0;
+
+    // Every corner of a triangle that crosses the ground is pinned, so the
+    // line where the surface meets z = 0 can't move.
+    flags.assign(num_vertices, 0);
+    side.resize((size_t)num_vertices * 2);
+    for ( uint32_t t = 0 ; t < num_triangles ; t++ )
+    {
+	const uint32_t	*v = &indices[t * 3];
+	if ( z[v[0]] <= 0.0f || z[v[1]] <= 0.0f || z[v[2]] <= 0.0f )
+	    flags[v[0]] = flags[v[1]] = flags[v[2]] = PINNED;
+    }
+
+    Quadric zero;
+    for ( int i = 0 ; i < 10 ; i++ )
+	zero.q[i] = 0.0;
+    zero.area = 0.0;
+    quadrics.assign(num_vertices, zero);
+
+    for ( uint32_t t = 0 ; t < num_triangles ; t++ )
+    {
+	const uint32_t	*v = &indices[t * 3];
+	double	p[3][3];
+	for ( int k = 0 ; k < 3 ; k++ )
+	{
+	    p[k][0] = x[v[k]];
+	    p[k][1] = y[v[k]];
+	    p[k][2] = z[v[k]];
+	}
+	double	e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+	double	e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+	double	n[3];
+	Cross(e1, e2, n);
+	double	length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	if ( length == 0.0 )
+	    continue;
+	n[0] /= length;
+	n[1] /= length;
+	n[2] /= length;
+	double	d = -( n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2] );
+	for ( int k = 0 ; k < 3 ; k++ )
+	{
+	    AddPlane(quadrics[v[k]], n, d, length * 0.5);
+	    quadrics[v[k]].area += length * 0.5;
+	}
+
+	// An edge no other triangle has, walked the other way, is on the
+	// border.
+	for ( int k = 0 ; k < 3 ; k++ )
+	{
+	    uint32_t	a = v[k], b = v[(k + 1) % 3];
+	    bool	border = true;
+	    for ( size_t i = 0 ; i < around[b].size() && border ; i++ )
+	    {
+		const uint32_t	*o = &indices[around[b][i] * 3];
+		for ( int j = 0 ; j < 3 ; j++ )
+		    if ( o[j] == b && o[(j + 1) % 3] == a )
+			border = false;
+	    }
+	    if ( ! border )
+		continue;
+
+	    double  e[3] = { p[(k + 1) % 3][0] - p[k][0], p[(k + 1) % 3][1] - p[k][1],
+			     p[(k + 1) % 3][2] - p[k][2] };
+
+	    // A vertex where the outline turns is a corner of it, and
+	    // collapses along either side would cut the corner off.
+	    double  run = sqrt(e[0] * e[0] + e[1] * e[1]);
+	    uint32_t	ends[2] = { a, b };
+	    for ( int j = 0 ; j < 2 && run > 0.0 ; j++ )
+	    {
+		float	*d = &side[ends[j] * 2];
+		float	dx = (float)( e[0] / run ), dy = (float)( e[1] / run );
+		if ( ! ( flags[ends[j]] & BORDER ) )
+		{
+		    d[0] = dx;
+		    d[1] = dy;
+		}
+		else if ( fabsf(d[0] * dy - d[1] * dx) > MAX_SIDE_TURN )
+		    flags[ends[j]] |= PINNED;
+	    }
+	    flags[a] |= BORDER;
+	    flags[b] |= BORDER;
+	    double  m[3];
+	    Cross(e, n, m);
+	    double  m_length = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+	    if ( m_length == 0.0 )
+		continue;
+	    m[0] /= m_length;
+	    m[1] /= m_length;
+	    m[2] /= m_length;
+	    double  md = -( m[0] * p[k][0] + m[1] * p[k][1] + m[2] * p[k][2] );
+	    double  weight = BOUNDARY_WEIGHT * ( e[0] * e[0] + e[1] * e[1] + e[2] * e[2] );
+	    AddPlane(quadrics[a], m, md, weight);
+	    AddPlane(quadrics[b], m, md, weight);
+	}
+    }
+
+    // Every edge once: inside edges from the triangle that walks them in
+    // increasing order, border edges from their only triangle.
+    Candidate	c;
+    heap.clear();
+    for ( uint32_t t = 0 ; t < num_triangles ; t++ )
+    {
+	const uint32_t	*v = &indices[t * 3];
+	for ( int k = 0 ; k < 3 ; k++ )
+	{
+	    uint32_t	a = v[k], b = v[(k + 1) % 3];
+	    if ( a > b && ! ( ( flags[a] & BORDER ) && ( flags[b] & BORDER ) ) )
+		continue;
+	    if ( Consider(a, b, c) )
+	    {
+		QueueEntry  e = { c.error, a, b, 0 };
+		heap.push_back(e);
+	    }
+	}
+    }
+    std::make_heap(heap.begin(), heap.end(), HeapOrder());
+
+    uint32_t	live = num_triangles;
+    while ( live > target_triangles && ! heap.empty() )
+    {
+	std::pop_heap(heap.begin(), heap.end(), HeapOrder());
+	QueueEntry  e = heap.back();
+	heap.pop_back();
+
+	if ( ( flags[e.a] & REMOVED ) || ( flags[e.b] & REMOVED )
+	     || stamp[e.a] + stamp[e.b] != e.stamp )
+	    continue;
+	if ( e.error > max_error )
+	    break;
+	// Evaluated again for the position, which isn't queued.
+	if ( ! Consider(e.a, e.b, c) || ! Collapsible(c) )
+	    continue;
+
+	for ( size_t i = 0 ; i < around[c.remove].size() ; i++ )
+	{
+	    const uint32_t  *v = &indices[around[c.remove][i] * 3];
+	    if ( v[0] == c.keep || v[1] == c.keep || v[2] == c.keep )
+		live--;
+	}
+	Collapse(c);
+    }
+
+    // Vertices are numbered in the order the remaining triangles use them.
+    // Each keeps the occlusion it had.
+    const bool	occluded = in.HasOcclusion();
+    out.Clear();
+    remap.assign(num_vertices, UNMAPPED);
+    for ( uint32_t t = 0 ; t < num_triangles ; t++ )
+    {
+	if ( dead[t] )
+	    continue;
+	uint32_t    v[3];
+	for ( int k = 0 ; k < 3 ; k++ )
+	{
+	    uint32_t	old = indices[t * 3 + k];
+	    if ( remap[old] == UNMAPPED )
+	    {
+		remap[old] = out.AddVertex(x[old], y[old], z[old]);
+		if ( occluded )
+		    out.occlusion.push_back(in.occlusion[old]);
+	    }
+	    v[k] = remap[old];
+	}
+	out.AddTriangle(v[0], v[1], v[2]);
+    }
+}
+
+
+void
+MountainDecimator::Release(void)
+{
+    std::vector<float>().swap(x);
+    std::vector<float>().swap(y);
+    std::vector<float>().swap(z);
+    std::vector<uint32_t>().swap(indices);
+    std::vector<bool>().swap(dead);
+    std::vector<std::vector<uint32_t> >().swap(around);
+    std::vector<Quadric>().swap(quadrics);
+    std::vector<uint32_t>().swap(stamp);
+    std::vector<uint8_t>().swap(flags);
+    std::vector<float>().swap(side);
+    std::vector<uint32_t>().swap(mark);
+    std::vector<QueueEntry>().swap(heap);
+    std::vector<uint32_t>().swap(remap);
+}
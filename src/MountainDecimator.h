@@ -0,0 +1,109 @@
+/*
+ * MountainDecimator.h: Header file for the class that simplifies a mountain
+ * level to a triangle budget with quadric error metrics.
+ *
+ */
+
+
+#ifndef _MOUNTAINDECIMATOR_H_
+#define _MOUNTAINDECIMATOR_H_
+
+#include <vector>
+#include <stdint.h>
+#include "MountainMesh.h"
+
+// Garland and Heckbert's edge collapse simplification. Every vertex carries
+// a quadric that sums the squared distances to the planes of the original
+// triangles around it, weighted by their areas, and edges are collapsed
+// cheapest first. Flat slopes cost nothing to collapse while ridges and
+// peaks cost a lot, so the triangles that remain gather where the shape
+// needs them.
+//
+// The outline of the mesh stays exactly where it was: a vertex on the
+// border only ever collapses along it, into the point of the edge that
+// costs least, and the corners where it turns never move. Border edges
+// also get planes at right angles to their triangle, so the shape of the
+// outline in z is kept too. The corners of triangles that reach the
+// ground never move, so the line where the mountain meets the ground at
+// z = 0 is exactly where it was, and nothing else is moved below it.
+// Collapses that would flip a triangle, or make the mesh non-manifold,
+// are skipped.
+class MountainDecimator {
+  private:
+    // A symmetric 4x4 matrix, stored as its upper triangle, and the area of
+    // the triangles that went into it.
+    struct Quadric {
+	double	q[10];
+	double	area;
+    };
+
+    // A possible collapse of remove into keep, which moves to position.
+    struct Candidate {
+	float	    error;	// Root mean square distance it would add.
+	uint32_t    keep;
+	uint32_t    remove;
+	float	    position[3];
+    };
+
+    // An edge in the queue, with its error when it was queued. Kept small,
+    // as the queue is the bulk of the memory traffic.
+    struct QueueEntry {
+	float	    error;
+	uint32_t    a;
+	uint32_t    b;
+	uint32_t    stamp;	// Sum of the stamps of a and b. Stale once
+				// either changes.
+    };
+
+    static const float	BOUNDARY_WEIGHT;    // Of the planes along borders.
+    static const float	MIN_NORMAL_COS;	    // Sharpest turn of a triangle
+					    // a collapse may cause.
+
+    // Cheapest first. A function object, so the heap operations inline it.
+    struct HeapOrder {
+	bool	operator()(const QueueEntry &a, const QueueEntry &b) const
+		    { return a.error > b.error; };
+    };
+
+    std::vector<float>	    x;		// Working copy of the mesh.
+    std::vector<float>	    y;
+    std::vector<float>	    z;
+    std::vector<uint32_t>   indices;
+    std::vector<bool>	    dead;	// Per triangle.
+    std::vector<std::vector<uint32_t> > around;	// Triangles per vertex.
+    std::vector<Quadric>    quadrics;
+    std::vector<uint32_t>   stamp;	// Bumped whenever a vertex changes.
+    std::vector<uint8_t>    flags;	// Per vertex, below.
+    std::vector<float>	    side;	// x, y direction of a border edge
+					// at each border vertex.
+    std::vector<uint32_t>   mark;	// For visiting neighbors once.
+    uint32_t		    mark_value;
+    std::vector<QueueEntry> heap;
+    std::vector<uint32_t>   remap;	// Output number of each vertex.
+
+    void    AddPlane(Quadric &dest, const double n[3], double d, double weight);
+    double  Evaluate(const Quadric &q, const float p[3]) const;
+    bool    Consider(uint32_t a, uint32_t b, Candidate &c) const;
+    void    Push(uint32_t a, uint32_t b, float error);
+    void    PushNeighbors(uint32_t v);
+    bool    Collapsible(const Candidate &c);
+    bool    Flips(uint32_t moved, uint32_t other, const float p[3]) const;
+    void    Collapse(const Candidate &c);
+
+  public:
+    MountainDecimator(void) { mark_value = 0; };
+
+    // Simplifies in into out, stopping once out has no more than
+    // target_triangles triangles, or when the next collapse would move the
+    // surface by more than max_error on average around it, whichever comes
+    // first. Only positions, indices and the occlusion of the vertices
+    // that remain are written; out must be shaded afterwards.
+    void    Decimate(const MountainMesh &in, MountainMesh &out,
+		     uint32_t target_triangles, float max_error);
+
+    // Frees the scratch storage kept between levels.
+    void    Release(void);
+};
+
+
+#endif
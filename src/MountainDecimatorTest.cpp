@@ -0,0 +1,116 @@
+/*
+ * MountainDecimatorTest.cpp: Checks that decimating mountain levels keeps
+ * them on the ground and within their outline, with no window.
+ *
+ * Usage: mountain_decimator_test
+ *
+ * Builds the levels as the builder thread does and decimates them: level 9
+ * with the budget and tolerance Mountain uses, and level 7 with a
+ * tolerance large enough to collapse almost everything. Every vertex that
+ * remains must be at or above z = 0 and over one of the base triangles.
+ * Exits with the number of failed checks.
+ */
+
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "MountainMesh.h"
+#include "MountainSubdivider.h"
+#include "MountainOptimizer.h"
+#include "MountainDecimator.h"
+#include "MountainParams.h"
+
+// How far outside its outline a vertex may be, for rounding.
+static const float	OUTLINE_SLACK = 1e-4f;
+
+static int  failures = 0;
+
+
+// Whether x, y is over base triangle t, up to OUTLINE_SLACK.
+static bool
+Over(int t, float x, float y)
+{
+    const float (*c)[3] = MountainParams::BASE_TRIANGLES[t];
+    for ( int k = 0 ; k < 3 ; k++ )
+    {
+	const float *a = c[k], *b = c[( k + 1 ) % 3], *o = c[( k + 2 ) % 3];
+	float	ex = b[0] - a[0], ey = b[1] - a[1];
+	float	length = sqrtf(ex * ex + ey * ey);
+	float	side = ( ex * ( y - a[1] ) - ey * ( x - a[0] ) ) / length;
+	float	inside = ex * ( o[1] - a[1] ) - ey * ( o[0] - a[0] );
+	if ( ( inside > 0.0f ? side : -side ) < -OUTLINE_SLACK )
+	    return false;
+    }
+    return true;
+}
+
+
+static void
+CheckLevel(const char *what, const MountainMesh &in, uint32_t budget, float tolerance)
+{
+    MountainDecimator	decimator;
+    MountainMesh	out;
+
+    decimator.Decimate(in, out, budget, tolerance);
+
+    uint32_t	below = 0, outside = 0;
+    float	lowest = 0.0f;
+    for ( uint32_t v = 0 ; v < out.NumVertices() ; v++ )
+    {
+	if ( out.z[v] < 0.0f )
+	    below++;
+	lowest = std::min(lowest, out.z[v]);
+	bool	over = false;
+	for ( int t = 0 ; t < MountainParams::NUM_BASE_TRIANGLES && ! over ; t++ )
+	    over = Over(t, out.x[v], out.y[v]);
+	if ( ! over )
+	{
+	    if ( ! outside )
+		printf("  outside: (%g, %g, %g)\n", out.x[v], out.y[v], out.z[v]);
+	    outside++;
+	}
+    }
+    printf("%s: %u triangles to %u, %u below ground (lowest %g), %u outside\n",
+	   what, in.NumTriangles(), out.NumTriangles(), below, lowest, outside);
+    if ( below || outside || ! out.NumTriangles() )
+    {
+	printf("FAIL %s\n", what);
+	failures++;
+    }
+}
+
+
+int
+main(void)
+{
+    std::vector<MountainMesh>	levels(10);
+    MountainSubdivider		subdivider;
+    MountainOptimizer		optimizer;
+    float			range = MountainParams::BASE_RANGE;
+
+    for ( int i = 0 ; i < MountainParams::NUM_BASE_TRIANGLES ; i++ )
+    {
+	const float (*t)[3] = MountainParams::BASE_TRIANGLES[i];
+	uint32_t    i1 = levels[0].AddVertex(t[0][0], t[0][1], t[0][2]);
+	uint32_t    i2 = levels[0].AddVertex(t[1][0], t[1][1], t[1][2]);
+	uint32_t    i3 = levels[0].AddVertex(t[2][0], t[2][1], t[2][2]);
+	levels[0].AddTriangle(i1, i2, i3);
+    }
+    levels[0].LinkTwins();
+    for ( int l = 1 ; l < (int)levels.size() ; l++ )
+    {
+	subdivider.Subdivide(levels[l - 1], levels[l], 1, l - 1, range);
+	optimizer.Optimize(levels[l]);
+	range *= MountainParams::RANGE_RATIO;
+    }
+
+    CheckLevel("level 9", levels[9], MountainParams::DECIMATE_BUDGET,
+	       MountainParams::DECIMATE_TOLERANCE);
+    CheckLevel("level 7, coarse", levels[7], 1024, 1.0f);
+
+    if ( ! failures )
+	printf("all passed\n");
+    return failures;
+}
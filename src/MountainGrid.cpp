@@ -0,0 +1,132 @@
+/*
+ * MountainGrid.cpp: Heightfield mountain peaks.
+ *
+ * Samples are numbered as in the header: row j holds samples (0, j) to
+ * (n - j, j), where n = size - 1 is the number of steps along a leg. The
+ * lattice triangles are the "up" triangles (a+1, b), (a, b+1), (a, b) and
+ * the "down" triangles (a+1, b), (a+1, b+1), (a, b+1), in mesh winding.
+ */
+
+
+#include "MountainGrid.h"
+#include "MountainRandom.h"
+#include <string.h>
+#include "Parallel.h"
+
+
+void
+MountainGrid::Reset(const float corners[3][3], int start_level)
+{
+    memcpy(corner, corners, sizeof(corner));
+    level = start_level;
+    size = 2;
+    heights.resize(3);
+    heights[0] = corner[2][2];	// (0, 0), the right angle.
+    heights[1] = corner[0][2];	// (1, 0)
+    heights[2] = corner[1][2];	// (0, 1)
+}
+
+
+void
+MountainGrid::Subdivide(const MountainGrid &in, uint64_t seed, float rand_range)
+{
+    memcpy(corner, in.corner, sizeof(corner));
+    level = in.level + 1;
+    size = ( in.size - 1 ) * 2 + 1;
+    heights.resize(NumSamples());
+
+    const uint64_t  level_key = MountainRandom::LevelKey(seed, in.level);
+
+    ParallelFor((int)size, [&](int task) {
+	uint32_t    j = (uint32_t)task;
+	uint32_t    length = size - j;
+	float	    *out = &heights[RowStart(j)];
+
+	// Midpoints first. Even rows lie on a row of the last level, and
+	// odd rows between two of them, so each is a pass over at most two
+	// contiguous rows.
+	if ( j % 2 == 0 )
+	{
+	    const float	*a = &in.heights[in.RowStart(j / 2)];
+	    for ( uint32_t i = 0 ; i < length ; i += 2 )
+		out[i] = a[i / 2];
+	    for ( uint32_t i = 1 ; i < length ; i += 2 )
+		out[i] = ( a[i / 2] + a[i / 2 + 1] ) * 0.5f;
+	}
+	else
+	{
+	    const float	*a = &in.heights[in.RowStart(j / 2)];
+	    const float	*b = &in.heights[in.RowStart(j / 2 + 1)];
+	    for ( uint32_t i = 0 ; i < length ; i += 2 )
+		out[i] = ( a[i / 2] + b[i / 2] ) * 0.5f;
+	    for ( uint32_t i = 1 ; i < length ; i += 2 )
+		out[i] = ( a[i / 2 + 1] + b[i / 2] ) * 0.5f;
+	}
+
+	// Then displace the new samples above the ground, keyed by the ends
+	// of the edge each one splits, exactly as MountainSubdivider does.
+	uint32_t    step = j % 2 == 0 ? 2 : 1;
+	for ( uint32_t i = j % 2 == 0 ? 1 : 0 ; i < length ; i += step )
+	{
+	    if ( out[i] <= 0 )
+		continue;
+
+	    uint32_t	i1, j1, i2, j2;
+	    if ( j % 2 == 0 )
+	    {
+		i1 = i - 1;	// Along the row.
+		j1 = j;
+		i2 = i + 1;
+		j2 = j;
+	    }
+	    else if ( i % 2 == 0 )
+	    {
+		i1 = i;		// Across two rows.
+		j1 = j - 1;
+		i2 = i;
+		j2 = j + 1;
+	    }
+	    else
+	    {
+		i1 = i + 1;	// Along the diagonal.
+		j1 = j - 1;
+		i2 = i - 1;
+		j2 = j + 1;
+	    }
+
+	    float   random = MountainRandom::KeyUniform(level_key,
+			MountainRandom::PointKey(Coordinate(0, i1, j1), Coordinate(1, i1, j1)),
+			MountainRandom::PointKey(Coordinate(0, i2, j2), Coordinate(1, i2, j2)));
+	    out[i] += -rand_range + random * ( 2 * rand_range );
+	    if ( out[i] < 0 )
+		out[i] = 0;
+	}
+    });
+}
+
+
+void
+MountainGrid::Coarsen(const MountainGrid &in)
+{
+    memcpy(corner, in.corner, sizeof(corner));
+    level = in.level - 1;
+    size = ( in.size - 1 ) / 2 + 1;
+    heights.resize(NumSamples());
+
+    ParallelFor((int)size, [&](int task) {
+	uint32_t    j = (uint32_t)task;
+	const float *a = &in.heights[in.RowStart(j * 2)];
+	float	    *out = &heights[RowStart(j)];
+	for ( uint32_t i = 0 ; i < size - j ; i++ )
+	    out[i] = a[i * 2];
+    });
+}
+
+
+void
+MountainGrid::Release(void)
+{
+    std::vector<float>().swap(heights);
+    size = 0;
+    level = 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * MountainGrid.h: Header file for a mountain peak stored as a regular
+ * heightfield, the grid alternative to subdividing a triangle mesh.
+ *
+ */
+
+
+#ifndef _MOUNTAINGRID_H_
+#define _MOUNTAINGRID_H_
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include "MountainMesh.h"
+
+template <class Lattice>
+void	MountainGridSample(const Lattice &lattice, uint32_t i, uint32_t j,
+			   uint32_t stride, MountainVertex &v);
+
+// Uniform four-way subdivision of a right isosceles base triangle puts its
+// vertices on a triangular lattice: sample (i, j) sits i steps from the
+// right-angle corner towards the first corner and j steps towards the
+// second, with i + j at most the number of steps along a leg. Only the
+// heights are stored, one float per sample, row by row. Positions follow
+// from the corners, and neighbors from the row layout, so no adjacency is
+// looked up anywhere.
+//
+// Each level is a single midpoint displacement pass: every new sample is
+// the middle of a horizontal, vertical or diagonal lattice edge of the
+// previous level, displaced with the same MountainRandom number as
+// MountainSubdivider uses for that edge. When the corners have small
+// integer coordinates, as the built-in ones do, every position is exact
+// and the heights match the subdivided mesh bit for bit. Rows are
+// independent, so they are generated in parallel.
+class MountainGrid {
+  private:
+    float	corner[3][3];	// The first, second and right-angle corners.
+    int		level;
+    uint32_t	size;		// Samples along a leg, 2^level + 1.
+    std::vector<float>	heights;
+
+    // Index of the first sample of row j.
+    size_t	RowStart(uint32_t j) const
+		    { return (size_t)j * size - (size_t)j * ( j - 1 ) / 2; };
+
+  public:
+    MountainGrid(void) { level = 0; size = 0; };
+
+    // Starts over with the triangle given by three x, y, z corners, the
+    // right angle last. A triangle of a deeper level's lattice can be
+    // started at that level, and then gets exactly the samples the whole
+    // grid would have inside it.
+    void    Reset(const float corners[3][3], int start_level = 0);
+
+    // Makes this the next level of in, displacing every new sample above
+    // the ground by up to +- rand_range. Samples on the ground stay there.
+    void    Subdivide(const MountainGrid &in, uint64_t seed, float rand_range);
+
+    // Makes this the level before in, which only drops samples, as a
+    // level never moves the samples it started with.
+    void    Coarsen(const MountainGrid &in);
+
+    int		Level(void) const { return level; };
+    uint32_t	Steps(void) const { return size - 1; };
+    uint32_t	NumSamples(void) const { return size * ( size + 1 ) / 2; };
+
+    // The x (axis 0) or y (axis 1) of sample (i, j). Computed straight from
+    // the corners, which is exact wherever nested midpoints are.
+    float	Coordinate(int axis, uint32_t i, uint32_t j) const
+		    { return Coordinate(corner, size - 1, axis, i, j); };
+    static float    Coordinate(const float corners[3][3], uint32_t steps,
+			       int axis, uint32_t i, uint32_t j)
+		{
+		    return ( corners[2][axis] * (float)( steps - i - j )
+			   + corners[0][axis] * (float)i
+			   + corners[1][axis] * (float)j ) / (float)steps;
+		};
+    float	Height(uint32_t i, uint32_t j) const
+		    { return heights[RowStart(j) + i]; };
+    // All the heights, row by row.
+    const float	*Heights(void) const { return heights.data(); };
+
+    // Makes sample (i, j) into a vertex, with a smooth normal and color
+    // computed as MountainMesh::ComputeShading does, for the coarser
+    // lattice that only keeps every stride'th sample. i and j must be
+    // multiples of stride.
+    void    Sample(uint32_t i, uint32_t j, uint32_t stride, MountainVertex &v) const
+		{ MountainGridSample(*this, i, j, stride, v); };
+
+    // Bytes of storage currently held.
+    size_t  MemoryBytes(void) const { return heights.capacity() * sizeof(float); };
+
+    // Frees all storage.
+    void    Release(void);
+};
+
+// MountainGrid::Sample, for anything with the Steps, Coordinate and Height of
+// a grid, so that a grid stored some other way is shaded exactly the same.
+template <class Lattice>
+void
+MountainGridSample(const Lattice &lattice, uint32_t i, uint32_t j, uint32_t stride,
+		   MountainVertex &v)
+{
+    // The six lattice triangles that can touch a sample, as offsets of
+    // their corners from it in strides, in mesh winding order.
+    static const int	around[6][3][2] = {
+	{ { 1, 0 }, { 0, 1 }, { 0, 0 } },	// Up, at its right angle.
+	{ { 0, 0 }, { -1, 1 }, { -1, 0 } },	// Up, at its first corner.
+	{ { 1, -1 }, { 0, 0 }, { 0, -1 } },	// Up, at its second corner.
+	{ { 0, 0 }, { 0, 1 }, { -1, 1 } },	// Down, at its first corner.
+	{ { 0, -1 }, { 0, 0 }, { -1, 0 } },	// Down, at its second.
+	{ { 1, -1 }, { 1, 0 }, { 0, 0 } }	// Down, at its last.
+    };
+    const int64_t   n = lattice.Steps();
+
+    v.position[0] = lattice.Coordinate(0, i, j);
+    v.position[1] = lattice.Coordinate(1, i, j);
+    v.position[2] = lattice.Height(i, j);
+
+    // Sum the unnormalized normals of the triangles that are on the
+    // lattice and not entirely on the ground.
+    float   sx = 0.0f, sy = 0.0f, sz = 0.0f;
+    for ( int t = 0 ; t < 6 ; t++ )
+    {
+	float	p[3][3];
+	bool	inside = true;
+	for ( int c = 0 ; c < 3 && inside ; c++ )
+	{
+	    int64_t ci = (int64_t)i + around[t][c][0] * (int64_t)stride;
+	    int64_t cj = (int64_t)j + around[t][c][1] * (int64_t)stride;
+	    inside = ci >= 0 && cj >= 0 && ci + cj <= n;
+	    if ( inside )
+	    {
+		p[c][0] = lattice.Coordinate(0, (uint32_t)ci, (uint32_t)cj);
+		p[c][1] = lattice.Coordinate(1, (uint32_t)ci, (uint32_t)cj);
+		p[c][2] = lattice.Height((uint32_t)ci, (uint32_t)cj);
+	    }
+	}
+	if ( ! inside || ! MountainMesh::AboveGround(p[0][2], p[1][2], p[2][2]) )
+	    continue;
+
+	float	ux = p[1][0] - p[0][0], uy = p[1][1] - p[0][1], uz = p[1][2] - p[0][2];
+	float	vx = p[2][0] - p[0][0], vy = p[2][1] - p[0][1], vz = p[2][2] - p[0][2];
+	sx += uy*vz - uz*vy;
+	sy += uz*vx - ux*vz;
+	sz += ux*vy - uy*vx;
+    }
+    float   len = sqrtf(sx*sx + sy*sy + sz*sz);
+    if ( len > 0.0f )
+    {
+	v.normal[0] = sx / len;
+	v.normal[1] = sy / len;
+	v.normal[2] = sz / len;
+    }
+    else
+    {
+	v.normal[0] = 0.0f;
+	v.normal[1] = 0.0f;
+	v.normal[2] = 1.0f;
+    }
+
+    unsigned char   c = MountainMesh::HeightGray(v.position[2]);
+    v.color[0] = v.color[1] = v.color[2] = c;
+    v.color[3] = 255;
+}
+
+
+#endif
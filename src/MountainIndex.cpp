@@ -0,0 +1,667 @@
+/*
+ * MountainIndex.cpp: Height, ray and nearest point queries on a mountain
+ * level.
+ *
+ */
+
+
+#include "MountainIndex.h"
+#include "Parallel.h"
+#include <math.h>
+#include <float.h>
+
+const uint32_t MountainIndex::NO_HIT = 0xFFFFFFFFu;
+const float MountainIndex::TRIANGLES_PER_CELL = 2.0f;
+
+// How far outside a triangle, in barycentric terms, a point may be and still
+// count as on it, so points on a shared edge aren't lost to rounding.
+static const float  EDGE_TOLERANCE = 1e-5f;
+
+// Most cells along either axis.
+static const int    MAX_CELLS = 1 << 14;
+// Quadtree levels over that many cells, the cells included.
+static const int    MAX_LEVELS = 15;
+
+// Queries handled by one parallel task.
+static const size_t QUERY_TASK_SIZE = 1024;
+
+
+void
+MountainIndex::Clear(void)
+{
+    x = y = z = NULL;
+    stride = 0;
+    indices = NULL;
+    num_triangles = 0;
+    cells[0] = cells[1] = 0;
+    first.clear();
+    listed.clear();
+    levels.clear();
+    low.clear();
+    high.clear();
+}
+
+
+void
+MountainIndex::Release(void)
+{
+    Clear();
+    std::vector<uint32_t>().swap(first);
+    std::vector<uint32_t>().swap(listed);
+    std::vector<Level>().swap(levels);
+    std::vector<float>().swap(low);
+    std::vector<float>().swap(high);
+}
+
+
+size_t
+MountainIndex::MemoryBytes(void) const
+{
+    return ( first.capacity() + listed.capacity() ) * sizeof(uint32_t)
+	   + levels.capacity() * sizeof(Level)
+	   + ( low.capacity() + high.capacity() ) * sizeof(float);
+}
+
+
+void
+MountainIndex::Corners(uint32_t t, float p[3][3]) const
+{
+    for ( int c = 0 ; c < 3 ; c++ )
+    {
+	uint32_t    v = indices[t * 3 + c];
+	p[c][0] = X(v);
+	p[c][1] = Y(v);
+	p[c][2] = Z(v);
+    }
+}
+
+
+// The cell along axis that holds value, clamped to the grid.
+int
+MountainIndex::Cell(int axis, float value) const
+{
+    float   c = floorf(( value - bounds[0][axis] ) / cell_size[axis]);
+    if ( c < 0.0f )
+	return 0;
+    if ( c >= (float)cells[axis] )
+	return cells[axis] - 1;
+    return (int)c;
+}
+
+
+void
+MountainIndex::Build(const float *px, const float *py, const float *pz, size_t s,
+		     const uint32_t *idx, uint32_t n)
+{
+    Clear();
+    if ( n == 0 )
+	return;
+
+    x = (const char *)px;
+    y = (const char *)py;
+    z = (const char *)pz;
+    stride = s;
+    indices = idx;
+    num_triangles = n;
+
+    for ( int k = 0 ; k < 3 ; k++ )
+    {
+	bounds[0][k] = FLT_MAX;
+	bounds[1][k] = -FLT_MAX;
+    }
+    for ( uint32_t i = 0 ; i < n * 3 ; i++ )
+    {
+	float	p[3] = { X(idx[i]), Y(idx[i]), Z(idx[i]) };
+	for ( int k = 0 ; k < 3 ; k++ )
+	{
+	    bounds[0][k] = std::min(bounds[0][k], p[k]);
+	    bounds[1][k] = std::max(bounds[1][k], p[k]);
+	}
+    }
+
+    // Square cells, as near as the extent allows.
+    float   width = std::max(bounds[1][0] - bounds[0][0], 1e-6f);
+    float   height = std::max(bounds[1][1] - bounds[0][1], 1e-6f);
+    float   size = sqrtf(width * height * TRIANGLES_PER_CELL / n);
+    cells[0] = std::max(1, std::min(MAX_CELLS, (int)ceilf(width / size)));
+    cells[1] = std::max(1, std::min(MAX_CELLS, (int)ceilf(height / size)));
+    cell_size[0] = width / cells[0];
+    cell_size[1] = height / cells[1];
+
+    // Count, offset, then fill the cells, as ComputeShading does the
+    // triangles around a vertex.
+    const size_t    num_cells = (size_t)cells[0] * cells[1];
+    first.assign(num_cells + 1, 0);
+    low.assign(num_cells, FLT_MAX);
+    high.assign(num_cells, -FLT_MAX);
+    for ( int pass = 0 ; pass < 2 ; pass++ )
+    {
+	for ( uint32_t t = 0 ; t < n ; t++ )
+	{
+	    float   p[3][3];
+	    Corners(t, p);
+	    int	    i0 = Cell(0, std::min(p[0][0], std::min(p[1][0], p[2][0])));
+	    int	    i1 = Cell(0, std::max(p[0][0], std::max(p[1][0], p[2][0])));
+	    int	    j0 = Cell(1, std::min(p[0][1], std::min(p[1][1], p[2][1])));
+	    int	    j1 = Cell(1, std::max(p[0][1], std::max(p[1][1], p[2][1])));
+	    float   bottom = std::min(p[0][2], std::min(p[1][2], p[2][2]));
+	    float   top = std::max(p[0][2], std::max(p[1][2], p[2][2]));
+	    for ( int j = j0 ; j <= j1 ; j++ )
+		for ( int i = i0 ; i <= i1 ; i++ )
+		{
+		    size_t  c = (size_t)j * cells[0] + i;
+		    if ( pass == 0 )
+		    {
+			first[c + 1]++;
+			low[c] = std::min(low[c], bottom);
+			high[c] = std::max(high[c], top);
+		    }
+		    else
+			listed[first[c]++] = t;
+		}
+	}
+
+	if ( pass == 0 )
+	{
+	    for ( size_t c = 0 ; c < num_cells ; c++ )
+		first[c + 1] += first[c];
+	    listed.resize(first[num_cells]);
+	}
+	else
+	{
+	    // Filling moved every start to the next one's.
+	    for ( size_t c = num_cells ; c > 0 ; c-- )
+		first[c] = first[c - 1];
+	    first[0] = 0;
+	}
+    }
+
+    // Each node of the quadtree spans the up to four below it.
+    Level   cell_level = { 0, { cells[0], cells[1] } };
+    levels.assign(1, cell_level);
+    while ( levels.back().nodes[0] > 1 || levels.back().nodes[1] > 1 )
+    {
+	const Level fine = levels.back();
+	Level	    coarse = { low.size(), { ( fine.nodes[0] + 1 ) / 2,
+					    ( fine.nodes[1] + 1 ) / 2 } };
+	for ( int j = 0 ; j < coarse.nodes[1] ; j++ )
+	    for ( int i = 0 ; i < coarse.nodes[0] ; i++ )
+	    {
+		float	bottom = FLT_MAX, top = -FLT_MAX;
+		for ( int b = 2 * j ; b < std::min(2 * j + 2, fine.nodes[1]) ; b++ )
+		    for ( int a = 2 * i ; a < std::min(2 * i + 2, fine.nodes[0]) ; a++ )
+		    {
+			size_t	n = fine.begin + (size_t)b * fine.nodes[0] + a;
+			bottom = std::min(bottom, low[n]);
+			top = std::max(top, high[n]);
+		    }
+		low.push_back(bottom);
+		high.push_back(top);
+	    }
+	levels.push_back(coarse);
+    }
+}
+
+
+void
+MountainIndex::Build(const MountainMesh &mesh)
+{
+    Build(mesh.x.data(), mesh.y.data(), mesh.z.data(), sizeof(float),
+	  mesh.indices.data(), mesh.NumTriangles());
+}
+
+
+void
+MountainIndex::Build(const MountainCache &cache)
+{
+    const MountainVertex    *v = cache.Vertices();
+    Build(&v->position[0], &v->position[1], &v->position[2], sizeof(MountainVertex),
+	  cache.Indices(), cache.NumIndices() / 3);
+}
+
+
+bool
+MountainIndex::Height(float px, float py, float &pz) const
+{
+    if ( num_triangles == 0 || px < bounds[0][0] || px > bounds[1][0]
+	 || py < bounds[0][1] || py > bounds[1][1] )
+	return false;
+
+    size_t  c = (size_t)Cell(1, py) * cells[0] + Cell(0, px);
+    bool    found = false;
+    for ( uint32_t k = first[c] ; k < first[c + 1] ; k++ )
+    {
+	float	p[3][3];
+	Corners(listed[k], p);
+
+	// Barycentric coordinates in xy. Steep triangles have none, and
+	// their edges are shared with triangles that do.
+	float	d = ( p[1][1] - p[2][1] ) * ( p[0][0] - p[2][0] )
+		    + ( p[2][0] - p[1][0] ) * ( p[0][1] - p[2][1] );
+	if ( d == 0.0f )
+	    continue;
+	float	b0 = ( ( p[1][1] - p[2][1] ) * ( px - p[2][0] )
+		       + ( p[2][0] - p[1][0] ) * ( py - p[2][1] ) ) / d;
+	float	b1 = ( ( p[2][1] - p[0][1] ) * ( px - p[2][0] )
+		       + ( p[0][0] - p[2][0] ) * ( py - p[2][1] ) ) / d;
+	float	b2 = 1.0f - b0 - b1;
+	if ( b0 < -EDGE_TOLERANCE || b1 < -EDGE_TOLERANCE || b2 < -EDGE_TOLERANCE )
+	    continue;
+
+	float	h = b0 * p[0][2] + b1 * p[1][2] + b2 * p[2][2];
+	if ( ! found || h > pz )
+	    pz = h;
+	found = true;
+    }
+    return found;
+}
+
+
+// Moller and Trumbore's test. Returns the distance along the ray, or a
+// negative value for a miss.
+static float
+RayTriangle(const float o[3], const float d[3], const float p[3][3])
+{
+    float   e1[3], e2[3], s[3], q[3], h[3];
+    for ( int k = 0 ; k < 3 ; k++ )
+    {
+	e1[k] = p[1][k] - p[0][k];
+	e2[k] = p[2][k] - p[0][k];
+	s[k] = o[k] - p[0][k];
+    }
+    h[0] = d[1] * e2[2] - d[2] * e2[1];
+    h[1] = d[2] * e2[0] - d[0] * e2[2];
+    h[2] = d[0] * e2[1] - d[1] * e2[0];
+    float   a = e1[0] * h[0] + e1[1] * h[1] + e1[2] * h[2];
+    if ( a == 0.0f )
+	return -1.0f;
+
+    float   u = ( s[0] * h[0] + s[1] * h[1] + s[2] * h[2] ) / a;
+    if ( u < -EDGE_TOLERANCE || u > 1.0f + EDGE_TOLERANCE )
+	return -1.0f;
+    q[0] = s[1] * e1[2] - s[2] * e1[1];
+    q[1] = s[2] * e1[0] - s[0] * e1[2];
+    q[2] = s[0] * e1[1] - s[1] * e1[0];
+    float   v = ( d[0] * q[0] + d[1] * q[1] + d[2] * q[2] ) / a;
+    if ( v < -EDGE_TOLERANCE || u + v > 1.0f + EDGE_TOLERANCE )
+	return -1.0f;
+    return ( e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2] ) / a;
+}
+
+
+// Nodes waiting to be opened, with the distance at which the ray, or the
+// point, gets to them.
+struct NodeEntry {
+    float   distance;
+    int	    level;
+    int	    i, j;
+
+    // Nearest first, as a heap.
+    bool    operator<(const NodeEntry &o) const { return distance > o.distance; };
+};
+
+
+bool
+MountainIndex::Intersect(const float o[3], const float d[3], float max_distance,
+			 Hit &hit) const
+{
+    hit.triangle = NO_HIT;
+    if ( num_triangles == 0 )
+	return false;
+
+    // Nodes are opened nearest first along the ray. Those it misses, or
+    // reaches only past the best hit so far, are passed over whole.
+    std::vector<NodeEntry>  stack;
+    float		    best = max_distance;
+    int			    root = (int)levels.size() - 1;
+    NodeEntry		    entry = { 0.0f, root, 0, 0 };
+    if ( ! NodeRay(o, d, best, root, 0, 0, entry.distance) )
+	return false;
+    stack.push_back(entry);
+    while ( ! stack.empty() )
+    {
+	NodeEntry   e = stack.back();
+	stack.pop_back();
+	if ( e.distance > best )
+	    continue;
+
+	if ( e.level > 0 )
+	{
+	    // Pushed farthest first, so the nearest comes off next.
+	    const Level &fine = levels[e.level - 1];
+	    NodeEntry	children[4];
+	    int		n = 0;
+	    for ( int j = 2 * e.j ; j < std::min(2 * e.j + 2, fine.nodes[1]) ; j++ )
+		for ( int i = 2 * e.i ; i < std::min(2 * e.i + 2, fine.nodes[0]) ; i++ )
+		{
+		    NodeEntry	child = { 0.0f, e.level - 1, i, j };
+		    if ( NodeRay(o, d, best, e.level - 1, i, j, child.distance) )
+			children[n++] = child;
+		}
+	    // At most four, so a plain insertion sort.
+	    for ( int k = 1 ; k < n ; k++ )
+	    {
+		NodeEntry   child = children[k];
+		int	    m = k;
+		for ( ; m > 0 && child < children[m - 1] ; m-- )
+		    children[m] = children[m - 1];
+		children[m] = child;
+	    }
+	    stack.insert(stack.end(), children, children + n);
+	    continue;
+	}
+
+	size_t	c = (size_t)e.j * cells[0] + e.i;
+	for ( uint32_t k = first[c] ; k < first[c + 1] ; k++ )
+	{
+	    float   p[3][3];
+	    Corners(listed[k], p);
+	    float   t = RayTriangle(o, d, p);
+	    if ( t >= 0.0f && t <= best )
+	    {
+		best = t;
+		hit.triangle = listed[k];
+	    }
+	}
+    }
+
+    if ( hit.triangle == NO_HIT )
+	return false;
+    hit.distance = best;
+    for ( int k = 0 ; k < 3 ; k++ )
+	hit.position[k] = o[k] + d[k] * best;
+    return true;
+}
+
+
+bool
+MountainIndex::Occluded(const float o[3], const float d[3], float max_distance) const
+{
+    if ( num_triangles == 0 )
+	return false;
+
+    // Any hit will do, so nodes are opened in no particular order, and the
+    // first triangle met ends the search. The search starts from the up to
+    // four nodes of the finest level that cover the ray in xy, rather than
+    // from the root, as the rays this is for are short. Each level leaves at
+    // most three siblings waiting, so the stack never outgrows a small array.
+    NodeEntry	stack[4 * MAX_LEVELS];
+    int		size = 0;
+    int		i0 = Cell(0, std::min(o[0], o[0] + d[0] * max_distance));
+    int		i1 = Cell(0, std::max(o[0], o[0] + d[0] * max_distance));
+    int		j0 = Cell(1, std::min(o[1], o[1] + d[1] * max_distance));
+    int		j1 = Cell(1, std::max(o[1], o[1] + d[1] * max_distance));
+    int		level = 0;
+    while ( ( i1 >> level ) - ( i0 >> level ) > 1 || ( j1 >> level ) - ( j0 >> level ) > 1 )
+	level++;
+    for ( int j = j0 >> level ; j <= j1 >> level ; j++ )
+	for ( int i = i0 >> level ; i <= i1 >> level ; i++ )
+	{
+	    NodeEntry	entry = { 0.0f, level, i, j };
+	    if ( NodeRay(o, d, max_distance, level, i, j, entry.distance) )
+		stack[size++] = entry;
+	}
+    while ( size > 0 )
+    {
+	NodeEntry   e = stack[--size];
+	if ( e.level > 0 )
+	{
+	    const Level &fine = levels[e.level - 1];
+	    for ( int j = 2 * e.j ; j < std::min(2 * e.j + 2, fine.nodes[1]) ; j++ )
+		for ( int i = 2 * e.i ; i < std::min(2 * e.i + 2, fine.nodes[0]) ; i++ )
+		{
+		    NodeEntry	child = { 0.0f, e.level - 1, i, j };
+		    if ( NodeRay(o, d, max_distance, e.level - 1, i, j, child.distance) )
+			stack[size++] = child;
+		}
+	    continue;
+	}
+
+	size_t	c = (size_t)e.j * cells[0] + e.i;
+	for ( uint32_t k = first[c] ; k < first[c + 1] ; k++ )
+	{
+	    float   p[3][3];
+	    Corners(listed[k], p);
+	    float   t = RayTriangle(o, d, p);
+	    if ( t >= 0.0f && t <= max_distance )
+		return true;
+	}
+    }
+    return false;
+}
+
+
+// The point of triangle p nearest to q, from Ericson's Real-Time Collision
+// Detection, by the Voronoi region q falls in.
+static void
+ClosestOnTriangle(const float q[3], const float p[3][3], float out[3])
+{
+    float   ab[3], ac[3], ap[3], bp[3], cp[3];
+    for ( int k = 0 ; k < 3 ; k++ )
+    {
+	ab[k] = p[1][k] - p[0][k];
+	ac[k] = p[2][k] - p[0][k];
+	ap[k] = q[k] - p[0][k];
+	bp[k] = q[k] - p[1][k];
+	cp[k] = q[k] - p[2][k];
+    }
+    float   d1 = ab[0] * ap[0] + ab[1] * ap[1] + ab[2] * ap[2];
+    float   d2 = ac[0] * ap[0] + ac[1] * ap[1] + ac[2] * ap[2];
+    float   d3 = ab[0] * bp[0] + ab[1] * bp[1] + ab[2] * bp[2];
+    float   d4 = ac[0] * bp[0] + ac[1] * bp[1] + ac[2] * bp[2];
+    float   d5 = ab[0] * cp[0] + ab[1] * cp[1] + ab[2] * cp[2];
+    float   d6 = ac[0] * cp[0] + ac[1] * cp[1] + ac[2] * cp[2];
+    float   va = d3 * d6 - d5 * d4;
+    float   vb = d5 * d2 - d1 * d6;
+    float   vc = d1 * d4 - d3 * d2;
+
+    // Weights of the three corners.
+    float   w[3];
+    if ( d1 <= 0.0f && d2 <= 0.0f )
+	w[0] = 1.0f, w[1] = 0.0f, w[2] = 0.0f;
+    else if ( d3 >= 0.0f && d4 <= d3 )
+	w[0] = 0.0f, w[1] = 1.0f, w[2] = 0.0f;
+    else if ( d6 >= 0.0f && d5 <= d6 )
+	w[0] = 0.0f, w[1] = 0.0f, w[2] = 1.0f;
+    else if ( vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f )
+    {
+	float	v = d1 / ( d1 - d3 );
+	w[0] = 1.0f - v, w[1] = v, w[2] = 0.0f;
+    }
+    else if ( vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f )
+    {
+	float	v = d2 / ( d2 - d6 );
+	w[0] = 1.0f - v, w[1] = 0.0f, w[2] = v;
+    }
+    else if ( va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f )
+    {
+	float	v = ( d4 - d3 ) / ( ( d4 - d3 ) + ( d5 - d6 ) );
+	w[0] = 0.0f, w[1] = 1.0f - v, w[2] = v;
+    }
+    else
+    {
+	float	sum = va + vb + vc;
+	w[1] = vb / sum;
+	w[2] = vc / sum;
+	w[0] = 1.0f - w[1] - w[2];
+    }
+
+    for ( int k = 0 ; k < 3 ; k++ )
+	out[k] = w[0] * p[0][k] + w[1] * p[1][k] + w[2] * p[2][k];
+}
+
+
+// The box around everything under a node, or false if there is nothing.
+// Every triangle is listed in the cells its points are over, and those
+// points are within the cells' heights, so the boxes hold every point of
+// the surface under them.
+bool
+MountainIndex::NodeBox(int level, int i, int j, float box[2][3]) const
+{
+    const Level &l = levels[level];
+    size_t	n = l.begin + (size_t)j * l.nodes[0] + i;
+    if ( low[n] > high[n] )
+	return false;
+
+    int	    span = 1 << level;
+    box[0][0] = bounds[0][0] + i * span * cell_size[0];
+    box[0][1] = bounds[0][1] + j * span * cell_size[1];
+    box[0][2] = low[n];
+    box[1][0] = bounds[0][0] + std::min(( i + 1 ) * span, cells[0]) * cell_size[0];
+    box[1][1] = bounds[0][1] + std::min(( j + 1 ) * span, cells[1]) * cell_size[1];
+    box[1][2] = high[n];
+
+    // Rounding in the cell lookup can put a point just outside its cell.
+    for ( int k = 0 ; k < 2 ; k++ )
+    {
+	box[0][k] -= cell_size[k] * EDGE_TOLERANCE;
+	box[1][k] += cell_size[k] * EDGE_TOLERANCE;
+    }
+    return true;
+}
+
+
+// The squared distance from q to the box of a node, or FLT_MAX if there is
+// nothing under it.
+float
+MountainIndex::NodeDistance(const float q[3], int level, int i, int j) const
+{
+    float   box[2][3];
+    if ( ! NodeBox(level, i, j, box) )
+	return FLT_MAX;
+
+    float   d2 = 0.0f;
+    for ( int k = 0 ; k < 3 ; k++ )
+    {
+	float	d = std::max(0.0f, std::max(box[0][k] - q[k], q[k] - box[1][k]));
+	d2 += d * d;
+    }
+    return d2;
+}
+
+
+// Where the ray from o along d, up to max_distance, enters the box of a node.
+// Returns false if it doesn't.
+bool
+MountainIndex::NodeRay(const float o[3], const float d[3], float max_distance,
+		       int level, int i, int j, float &enter) const
+{
+    float   box[2][3];
+    if ( ! NodeBox(level, i, j, box) )
+	return false;
+
+    float   exit = max_distance;
+    enter = 0.0f;
+    for ( int k = 0 ; k < 3 ; k++ )
+    {
+	if ( d[k] == 0.0f )
+	{
+	    if ( o[k] < box[0][k] || o[k] > box[1][k] )
+		return false;
+	    continue;
+	}
+	float	t0 = ( box[0][k] - o[k] ) / d[k];
+	float	t1 = ( box[1][k] - o[k] ) / d[k];
+	enter = std::max(enter, std::min(t0, t1));
+	exit = std::min(exit, std::max(t0, t1));
+    }
+    return enter <= exit;
+}
+
+
+bool
+MountainIndex::Nearest(const float q[3], Hit &hit) const
+{
+    hit.triangle = NO_HIT;
+    if ( num_triangles == 0 )
+	return false;
+
+    std::vector<NodeEntry>  heap;
+    float		    best = FLT_MAX;
+    NodeEntry		    root = { NodeDistance(q, (int)levels.size() - 1, 0, 0),
+				     (int)levels.size() - 1, 0, 0 };
+    heap.push_back(root);
+    while ( ! heap.empty() && heap.front().distance < best )
+    {
+	NodeEntry   e = heap.front();
+	std::pop_heap(heap.begin(), heap.end());
+	heap.pop_back();
+
+	if ( e.level > 0 )
+	{
+	    const Level &fine = levels[e.level - 1];
+	    for ( int j = 2 * e.j ; j < std::min(2 * e.j + 2, fine.nodes[1]) ; j++ )
+		for ( int i = 2 * e.i ; i < std::min(2 * e.i + 2, fine.nodes[0]) ; i++ )
+		{
+		    NodeEntry	child = { NodeDistance(q, e.level - 1, i, j),
+					  e.level - 1, i, j };
+		    if ( child.distance < best )
+		    {
+			heap.push_back(child);
+			std::push_heap(heap.begin(), heap.end());
+		    }
+		}
+	    continue;
+	}
+
+	size_t	c = (size_t)e.j * cells[0] + e.i;
+	for ( uint32_t k = first[c] ; k < first[c + 1] ; k++ )
+	{
+	    float   p[3][3], on[3];
+	    Corners(listed[k], p);
+	    ClosestOnTriangle(q, p, on);
+	    float   d2 = ( on[0] - q[0] ) * ( on[0] - q[0] )
+			 + ( on[1] - q[1] ) * ( on[1] - q[1] )
+			 + ( on[2] - q[2] ) * ( on[2] - q[2] );
+	    if ( d2 < best )
+	    {
+		best = d2;
+		hit.triangle = listed[k];
+		hit.position[0] = on[0];
+		hit.position[1] = on[1];
+		hit.position[2] = on[2];
+	    }
+	}
+    }
+
+    if ( hit.triangle == NO_HIT )
+	return false;
+    hit.distance = sqrtf(best);
+    return true;
+}
+
+
+void
+MountainIndex::Heights(size_t n, const float points[][2], float heights[],
+		       float missing) const
+{
+    ParallelFor((int)( ( n + QUERY_TASK_SIZE - 1 ) / QUERY_TASK_SIZE ), [&](int task) {
+	size_t	end = std::min(n, ( task + 1 ) * QUERY_TASK_SIZE);
+	for ( size_t i = task * QUERY_TASK_SIZE ; i < end ; i++ )
+	    if ( ! Height(points[i][0], points[i][1], heights[i]) )
+		heights[i] = missing;
+    });
+}
+
+
+void
+MountainIndex::Intersect(size_t n, const float origins[][3], const float directions[][3],
+			 float max_distance, Hit hits[]) const
+{
+    ParallelFor((int)( ( n + QUERY_TASK_SIZE - 1 ) / QUERY_TASK_SIZE ), [&](int task) {
+	size_t	end = std::min(n, ( task + 1 ) * QUERY_TASK_SIZE);
+	for ( size_t i = task * QUERY_TASK_SIZE ; i < end ; i++ )
+	    Intersect(origins[i], directions[i], max_distance, hits[i]);
+    });
+}
+
+
+void
+MountainIndex::Nearest(size_t n, const float points[][3], Hit hits[]) const
+{
+    ParallelFor((int)( ( n + QUERY_TASK_SIZE - 1 ) / QUERY_TASK_SIZE ), [&](int task) {
+	size_t	end = std::min(n, ( task + 1 ) * QUERY_TASK_SIZE);
+	for ( size_t i = task * QUERY_TASK_SIZE ; i < end ; i++ )
+	    Nearest(points[i], hits[i]);
+    });
+}
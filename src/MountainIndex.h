@@ -0,0 +1,123 @@
+/*
+ * MountainIndex.h: Header file for a spatial index over a mountain level,
+ * for asking where its surface is.
+ *
+ */
+
+
+#ifndef _MOUNTAININDEX_H_
+#define _MOUNTAININDEX_H_
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include "MountainMesh.h"
+#include "MountainCache.h"
+
+// A uniform grid over the xy extent of the level, with about two triangles
+// to a cell. Each cell lists every triangle whose xy bounds overlap it, and
+// a quadtree over the cells keeps the lowest and highest point under each
+// node. The mountain is a heightfield over each base triangle, so a height
+// lookup tests only the few triangles of one cell. Ray and nearest point
+// queries open the nodes of the quadtree nearest first, passing over any
+// whose box is no nearer than the best hit found so far, so they only reach
+// the cells around the answer.
+//
+// The index reads the level's vertices and indices in place, so they must
+// stay put for as long as it is used. Queries don't change the index, and
+// may be made from any number of threads at once.
+class MountainIndex {
+  public:
+    static const uint32_t   NO_HIT;
+
+    // Where a query met the surface.
+    struct Hit {
+	float	    distance;	// Along the ray, in lengths of its direction,
+				// or from the point.
+	float	    position[3];
+	uint32_t    triangle;	// NO_HIT if nothing was met.
+    };
+
+  private:
+    static const float	TRIANGLES_PER_CELL;
+
+    const char	*x;	    // The vertex arrays, each stride bytes apart.
+    const char	*y;
+    const char	*z;
+    size_t	stride;
+    const uint32_t  *indices;
+    uint32_t	num_triangles;
+
+    // A level of the quadtree. Its nodes each cover 2^level cells a side,
+    // and level 0 is the cells themselves.
+    struct Level {
+	size_t	begin;	    // First node in low and high.
+	int	nodes[2];   // Along x and y.
+    };
+
+    float	bounds[2][3];	// Of every triangle.
+    float	cell_size[2];
+    int		cells[2];	// Along x and y.
+    std::vector<uint32_t>   first;	// Triangles of each cell start at
+    std::vector<uint32_t>   listed;	// first, in listed.
+    std::vector<Level>	    levels;	// Finest first.
+    std::vector<float>	    low;	// Lowest and highest point under
+    std::vector<float>	    high;	// each node. Empty ones are inverted.
+
+    float   X(uint32_t v) const { return *(const float *)( x + v * stride ); };
+    float   Y(uint32_t v) const { return *(const float *)( y + v * stride ); };
+    float   Z(uint32_t v) const { return *(const float *)( z + v * stride ); };
+    void    Corners(uint32_t t, float p[3][3]) const;
+    int	    Cell(int axis, float value) const;
+    bool    NodeBox(int level, int i, int j, float box[2][3]) const;
+    float   NodeDistance(const float q[3], int level, int i, int j) const;
+    bool    NodeRay(const float o[3], const float d[3], float max_distance,
+		    int level, int i, int j, float &enter) const;
+
+  public:
+    MountainIndex(void) { Clear(); };
+
+    // Indexes the triangles of a level, reading vertex v's coordinates
+    // from x, y and z plus v times stride bytes.
+    void    Build(const float *px, const float *py, const float *pz, size_t stride,
+		  const uint32_t *indices, uint32_t num_triangles);
+    void    Build(const MountainMesh &mesh);
+    void    Build(const MountainCache &cache);
+
+    // Forgets the level, keeping the storage.
+    void    Clear(void);
+
+    // Frees all storage.
+    void    Release(void);
+
+    // Bytes of storage currently held.
+    size_t  MemoryBytes(void) const;
+
+    // The height of the highest surface straight above or below (x, y).
+    // Returns false if there is none.
+    bool    Height(float px, float py, float &pz) const;
+
+    // The first point where the ray from origin along direction meets the
+    // surface, no further than max_distance lengths of direction.
+    bool    Intersect(const float origin[3], const float direction[3],
+		      float max_distance, Hit &hit) const;
+
+    // Whether the ray meets the surface anywhere within max_distance. Faster
+    // than Intersect, as it stops at the first triangle it finds.
+    bool    Occluded(const float origin[3], const float direction[3],
+		     float max_distance) const;
+
+    // The point of the surface nearest to point.
+    bool    Nearest(const float point[3], Hit &hit) const;
+
+    // The same for many queries at once, spread over all cores. Heights
+    // off the surface are given as missing.
+    void    Heights(size_t n, const float points[][2], float heights[],
+		    float missing) const;
+    void    Intersect(size_t n, const float origins[][3], const float directions[][3],
+		      float max_distance, Hit hits[]) const;
+    void    Nearest(size_t n, const float points[][3], Hit hits[]) const;
+};
+
+
+#endif
@@ -0,0 +1,560 @@
+/*
+ * MountainLOD.cpp: ROAM-style continuous level of detail for the mountain.
+ *
+ * Triangles are stored in one pool and refer to each other by index. The
+ * two children of a triangle are always allocated next to each other. Their
+ * vertices and neighbor links follow Duchaineau et al.'s ROAM and the split
+ * bookkeeping in Turner's implementation notes.
+ */
+
+
+#include "MountainLOD.h"
+#include "MountainRandom.h"
+#include <math.h>
+#include <algorithm>
+
+const int MountainLOD::MAX_OPERATIONS_PER_FRAME = 1024;
+
+
+MountainLOD::MountainLOD(void)
+{
+    num_roots = 0;
+    num_leaves = 0;
+    seed = 0;
+    max_depth = 0;
+    budget = 4096;
+    tolerance = 1.0f;
+}
+
+
+void
+MountainLOD::Reset(const float base[][3][3], int num_base, uint64_t new_seed,
+		   float rand_start, float rand_ratio, int max_level)
+{
+    tris.clear();
+    free_pairs.clear();
+    x.clear();
+    y.clear();
+    z.clear();
+    free_vertices.clear();
+    root_diagonal.clear();
+    split_queue.clear();
+    merge_queue.clear();
+
+    seed = new_seed;
+    max_depth = std::min(max_level * 2, 250);
+
+    // Same running product as Mountain::Subdivide, so the ranges match it
+    // bit for bit.
+    amplitude.resize(max_level + 1);
+    float   range = rand_start;
+    for ( int l = 0 ; l <= max_level ; l++ )
+    {
+	amplitude[l] = range;
+	range *= rand_ratio;
+    }
+
+    // A triangle at depth d still has the displacements of every level from
+    // d / 2 on to come, which bounds how far its descendants can move.
+    error_bound.assign(max_depth + 1, 0.0f);
+    for ( int d = max_depth - 1 ; d >= 0 ; d-- )
+    {
+	float	below = d + 2 <= max_depth - 1 ? error_bound[d + 2] : 0.0f;
+	error_bound[d] = below + amplitude[d / 2];
+    }
+
+    num_roots = num_base;
+    for ( int i = 0 ; i < num_base ; i++ )
+    {
+	Triangle    t;
+	t.left = NewVertex(base[i][0][0], base[i][0][1], base[i][0][2]);
+	t.right = NewVertex(base[i][1][0], base[i][1][1], base[i][1][2]);
+	t.apex = NewVertex(base[i][2][0], base[i][2][1], base[i][2][2]);
+	t.left_nb = t.right_nb = t.base_nb = -1;
+	t.parent = -1;
+	t.child = -1;
+	t.stamp = 0;
+	t.depth = 0;
+	t.root = (uint8_t)i;
+	t.alive = true;
+	t.priority = 0.0f;
+	tris.push_back(t);
+
+	float	dx = base[i][1][0] - base[i][0][0];
+	float	dy = base[i][1][1] - base[i][0][1];
+	root_diagonal.push_back(dx * dy > 0 ? 1.0f : -1.0f);
+    }
+    num_leaves = num_base;
+}
+
+
+uint32_t
+MountainLOD::NewVertex(float vx, float vy, float vz)
+{
+    if ( ! free_vertices.empty() )
+    {
+	uint32_t    v = free_vertices.back();
+	free_vertices.pop_back();
+	x[v] = vx;
+	y[v] = vy;
+	z[v] = vz;
+	return v;
+    }
+
+    x.push_back(vx);
+    y.push_back(vy);
+    z.push_back(vz);
+    return (uint32_t)( x.size() - 1 );
+}
+
+
+int32_t
+MountainLOD::NewPair(void)
+{
+    if ( ! free_pairs.empty() )
+    {
+	int32_t	c = free_pairs.back();
+	free_pairs.pop_back();
+	return c;
+    }
+
+    Triangle	t;
+    t.stamp = 0;
+    t.alive = false;
+    tris.push_back(t);
+    tris.push_back(t);
+    return (int32_t)( tris.size() - 2 );
+}
+
+
+// The vertex splitting t, whose base neighbor is b. Uniform subdivision
+// makes every cell diagonal parallel to its root's hypotenuse, and the
+// center of a cell is the midpoint of that diagonal. When t's hypotenuse
+// is the other diagonal, the height therefore comes from the other two
+// corners of the square, which are t's apex and b's apex.
+uint32_t
+MountainLOD::Midpoint(int32_t t, int32_t b)
+{
+    if ( b >= 0 && tris[b].child >= 0 )
+	return tris[tris[b].child].apex;
+
+    const Triangle  &tri = tris[t];
+    uint32_t	e1 = tri.left;
+    uint32_t	e2 = tri.right;
+    float	dx = x[e2] - x[e1];
+    float	dy = y[e2] - y[e1];
+    if ( b >= 0 && dx != 0.0f && dy != 0.0f
+	 && ( dx * dy > 0 ) != ( root_diagonal[tri.root] > 0 ) )
+    {
+	e1 = tri.apex;
+	e2 = tris[b].apex;
+    }
+
+    // Children of a depth d triangle hold the vertices uniform level d / 2
+    // adds. This must stay in step with MountainSubdivider.
+    int	    level = tri.depth / 2;
+    float   range = amplitude[level];
+    float   mx = ( x[e1] + x[e2] ) * 0.5f;
+    float   my = ( y[e1] + y[e2] ) * 0.5f;
+    float   mz = ( z[e1] + z[e2] ) * 0.5f;
+    if ( mz > 0 )
+    {
+	float	random = MountainRandom::EdgeUniform(seed, level,
+					x[e1], y[e1], x[e2], y[e2]);
+	mz += -range + random * ( 2 * range );
+	if ( mz < 0 )
+	    mz = 0;
+    }
+
+    return NewVertex(mx, my, mz);
+}
+
+
+void
+MountainLOD::ReplaceNeighbor(int32_t n, int32_t old_nb, int32_t new_nb)
+{
+    if ( n < 0 )
+	return;
+
+    Triangle	&tri = tris[n];
+    if ( tri.base_nb == old_nb )
+	tri.base_nb = new_nb;
+    else if ( tri.left_nb == old_nb )
+	tri.left_nb = new_nb;
+    else if ( tri.right_nb == old_nb )
+	tri.right_nb = new_nb;
+}
+
+
+void
+MountainLOD::Split(int32_t t)
+{
+    if ( tris[t].child >= 0 )
+	return;
+
+    // Only a diamond can split without a crack. If the base neighbor is
+    // coarser, split it first; that makes one of its children our base
+    // neighbor.
+    int32_t b = tris[t].base_nb;
+    if ( b >= 0 && tris[b].base_nb != t )
+	Split(b);
+    b = tris[t].base_nb;
+
+    uint32_t	m = Midpoint(t, b);
+    int32_t	c = NewPair();	    // May move the pool, so no references
+				    // are held across it.
+    Triangle	&tri = tris[t];
+    Triangle	&lc = tris[c];
+    Triangle	&rc = tris[c + 1];
+
+    lc.apex = m;
+    lc.left = tri.apex;
+    lc.right = tri.left;
+    rc.apex = m;
+    rc.left = tri.right;
+    rc.right = tri.apex;
+
+    lc.base_nb = tri.left_nb;
+    lc.left_nb = c + 1;
+    lc.right_nb = -1;
+    rc.base_nb = tri.right_nb;
+    rc.right_nb = c;
+    rc.left_nb = -1;
+
+    lc.parent = rc.parent = t;
+    lc.child = rc.child = -1;
+    lc.stamp++;
+    rc.stamp++;
+    lc.depth = rc.depth = tri.depth + 1;
+    lc.root = rc.root = tri.root;
+    lc.alive = rc.alive = true;
+    lc.priority = rc.priority = 0.0f;
+
+    tri.child = c;
+    tri.stamp++;
+    num_leaves++;
+
+    ReplaceNeighbor(tri.left_nb, t, c);
+    ReplaceNeighbor(tri.right_nb, t, c + 1);
+
+    if ( b >= 0 )
+    {
+	if ( tris[b].child >= 0 )
+	{
+	    int32_t bc = tris[b].child;
+	    tris[bc].right_nb = c + 1;
+	    tris[bc + 1].left_nb = c;
+	    tris[c].right_nb = bc + 1;
+	    tris[c + 1].left_nb = bc;
+	}
+	else
+	    Split(b);
+    }
+
+    PushSplit(c);
+    PushSplit(c + 1);
+    PushMerge(t);
+}
+
+
+// Undoes the split of t alone. Its children must be leaves.
+void
+MountainLOD::MergeOne(int32_t t)
+{
+    int32_t c = tris[t].child;
+    int32_t ln = tris[c].base_nb;
+    int32_t rn = tris[c + 1].base_nb;
+
+    // The children's bases are the current neighbors across t's legs.
+    tris[t].left_nb = ln;
+    ReplaceNeighbor(ln, c, t);
+    tris[t].right_nb = rn;
+    ReplaceNeighbor(rn, c + 1, t);
+
+    tris[c].alive = tris[c + 1].alive = false;
+    tris[c].stamp++;
+    tris[c + 1].stamp++;
+    free_pairs.push_back(c);
+
+    tris[t].child = -1;
+    tris[t].stamp++;
+    num_leaves--;
+
+    PushSplit(t);
+    if ( tris[t].parent >= 0 )
+	PushMerge(tris[t].parent);
+}
+
+
+void
+MountainLOD::Merge(int32_t t)
+{
+    int32_t b = tris[t].base_nb;
+
+    free_vertices.push_back(tris[tris[t].child].apex);
+    MergeOne(t);
+    if ( b >= 0 )
+	MergeOne(b);
+}
+
+
+bool
+MountainLOD::Mergeable(int32_t t) const
+{
+    const Triangle  &tri = tris[t];
+    if ( ! tri.alive || tri.child < 0 || tris[tri.child].child >= 0
+	 || tris[tri.child + 1].child >= 0 )
+	return false;
+
+    int32_t b = tri.base_nb;
+    if ( b < 0 )
+	return true;
+
+    const Triangle  &base = tris[b];
+    return base.base_nb == t && base.child >= 0
+	&& tris[base.child].child < 0 && tris[base.child + 1].child < 0;
+}
+
+
+// The error t's descendants could add, projected to pixels. Zero for
+// triangles that can't split, lie on the ground, or are out of view.
+float
+MountainLOD::Priority(int32_t t) const
+{
+    const Triangle  &tri = tris[t];
+    if ( tri.depth >= max_depth )
+	return 0.0f;
+
+    // On the ground, unless the split point takes its height from the far
+    // side of the diamond, which may not be.
+    float   za = z[tri.apex], zl = z[tri.left], zr = z[tri.right];
+    if ( za <= 0 && zl <= 0 && zr <= 0
+	 && ( tri.base_nb < 0 || z[tris[tri.base_nb].apex] <= 0 ) )
+	return 0.0f;
+
+    // A sphere around the triangle and everything that can grow from it.
+    float   error = error_bound[tri.depth];
+    float   cx = ( x[tri.left] + x[tri.right] ) * 0.5f;
+    float   cy = ( y[tri.left] + y[tri.right] ) * 0.5f;
+    float   zmin = std::min(za, std::min(zl, zr)) - error;
+    float   zmax = std::max(za, std::max(zl, zr)) + error;
+    float   cz = ( zmin + zmax ) * 0.5f;
+    float   hx = x[tri.right] - x[tri.left];
+    float   hy = y[tri.right] - y[tri.left];
+    float   half_z = ( zmax - zmin ) * 0.5f;
+    float   radius = sqrtf(( hx * hx + hy * hy ) * 0.25f + half_z * half_z);
+
+    if ( ! view.SphereVisible(cx, cy, cz, radius) )
+	return 0.0f;
+
+    float   dx = cx - view.eye[0], dy = cy - view.eye[1], dz = cz - view.eye[2];
+    float   dist = sqrtf(dx * dx + dy * dy + dz * dz) - radius;
+    if ( dist < 0.1f )
+	dist = 0.1f;
+
+    return error * view.pixel_scale / dist;
+}
+
+
+float
+MountainLOD::DiamondPriority(int32_t t) const
+{
+    float   p = Priority(t);
+    if ( tris[t].base_nb >= 0 )
+	p = std::max(p, Priority(tris[t].base_nb));
+    return p;
+}
+
+
+void
+MountainLOD::PushSplit(int32_t t)
+{
+    QueueEntry	e;
+    e.priority = tris[t].priority = Priority(t);
+    e.triangle = t;
+    e.stamp = tris[t].stamp;
+    split_queue.push_back(e);
+    std::push_heap(split_queue.begin(), split_queue.end(), SplitOrder);
+}
+
+
+void
+MountainLOD::PushMerge(int32_t t)
+{
+    if ( ! Mergeable(t) )
+	return;
+
+    QueueEntry	e;
+    e.priority = DiamondPriority(t);
+    e.triangle = t;
+    e.stamp = tris[t].stamp;
+    merge_queue.push_back(e);
+    std::push_heap(merge_queue.begin(), merge_queue.end(), MergeOrder);
+}
+
+
+// Finds the highest priority leaf still in the split queue, discarding
+// entries made stale by later splits and merges. Leaves it on the heap.
+bool
+MountainLOD::TopSplit(QueueEntry &e)
+{
+    while ( ! split_queue.empty() )
+    {
+	e = split_queue.front();
+	const Triangle	&tri = tris[e.triangle];
+	if ( tri.alive && tri.stamp == e.stamp && tri.child < 0 )
+	    return true;
+	std::pop_heap(split_queue.begin(), split_queue.end(), SplitOrder);
+	split_queue.pop_back();
+    }
+    return false;
+}
+
+
+// As TopSplit, for the lowest priority mergeable diamond.
+bool
+MountainLOD::TopMerge(QueueEntry &e)
+{
+    while ( ! merge_queue.empty() )
+    {
+	e = merge_queue.front();
+	if ( tris[e.triangle].stamp == e.stamp && Mergeable(e.triangle) )
+	    return true;
+	std::pop_heap(merge_queue.begin(), merge_queue.end(), MergeOrder);
+	merge_queue.pop_back();
+    }
+    return false;
+}
+
+
+// Recomputes every priority for the new view and rebuilds both heaps.
+void
+MountainLOD::RebuildQueues(void)
+{
+    std::vector<int32_t>    stack;
+
+    split_queue.clear();
+    merge_queue.clear();
+
+    for ( int r = 0 ; r < num_roots ; r++ )
+	stack.push_back(r);
+    while ( ! stack.empty() )
+    {
+	int32_t	t = stack.back();
+	stack.pop_back();
+
+	QueueEntry  e;
+	e.triangle = t;
+	e.stamp = tris[t].stamp;
+	if ( tris[t].child < 0 )
+	{
+	    e.priority = tris[t].priority = Priority(t);
+	    split_queue.push_back(e);
+	    continue;
+	}
+	if ( Mergeable(t) )
+	{
+	    e.priority = DiamondPriority(t);
+	    merge_queue.push_back(e);
+	}
+	stack.push_back(tris[t].child);
+	stack.push_back(tris[t].child + 1);
+    }
+
+    std::make_heap(split_queue.begin(), split_queue.end(), SplitOrder);
+    std::make_heap(merge_queue.begin(), merge_queue.end(), MergeOrder);
+}
+
+
+bool
+MountainLOD::Update(const float mv[16], const float proj[16],
+		    const int viewport[4])
+{
+    if ( num_roots == 0 )
+	return false;
+
+    view.Set(mv, proj, viewport);
+
+    RebuildQueues();
+
+    bool    changed = false;
+    for ( int ops = 0 ; ops < MAX_OPERATIONS_PER_FRAME ; ops++ )
+    {
+	QueueEntry  s, m;
+	bool	    have_split = TopSplit(s);
+	bool	    have_merge = TopMerge(m);
+
+	if ( num_leaves > budget )
+	{
+	    if ( ! have_merge )
+		break;
+	    Merge(m.triangle);
+	}
+	else if ( have_split && s.priority > tolerance )
+	{
+	    if ( num_leaves + 2 <= budget )
+		Split(s.triangle);
+	    else if ( have_merge && m.priority < s.priority * 0.5f
+		      && tris[s.triangle].parent != m.triangle
+		      && tris[s.triangle].parent != tris[m.triangle].base_nb )
+		// Out of triangles: move detail to where it matters more.
+		// The margin keeps a pair from trading places every frame.
+		Merge(m.triangle);
+	    else
+		break;
+	}
+	else if ( have_merge && m.priority < tolerance * 0.5f )
+	    // Refined more than this view needs.
+	    Merge(m.triangle);
+	else
+	    break;
+
+	changed = true;
+    }
+
+    return changed;
+}
+
+
+void
+MountainLOD::Extract(MountainMesh &out)
+{
+    std::vector<int32_t>    stack;
+
+    // The pool also holds vertices freed by merges, and vertices of split
+    // triangles are shared with their leaves, so vertices are copied as the
+    // leaves first use them.
+    out.Clear();
+    out_index.assign(x.size(), 0xFFFFFFFFu);
+
+    for ( int r = num_roots - 1 ; r >= 0 ; r-- )
+	stack.push_back(r);
+    while ( ! stack.empty() )
+    {
+	int32_t	t = stack.back();
+	stack.pop_back();
+
+	const Triangle	&tri = tris[t];
+	if ( tri.child >= 0 )
+	{
+	    stack.push_back(tri.child + 1);
+	    stack.push_back(tri.child);
+	    continue;
+	}
+
+	// Leaves entirely below the ground are left out, as AddTriangle
+	// would, before their vertices are copied.
+	if ( ! MountainMesh::AboveGround(z[tri.left], z[tri.right], z[tri.apex]) )
+	    continue;
+
+	// Same winding as the base triangle the leaf came from.
+	uint32_t    v[3] = { tri.left, tri.right, tri.apex };
+	for ( int c = 0 ; c < 3 ; c++ )
+	{
+	    if ( out_index[v[c]] == 0xFFFFFFFFu )
+		out_index[v[c]] = out.AddVertex(x[v[c]], y[v[c]], z[v[c]]);
+	    v[c] = out_index[v[c]];
+	}
+	out.AddTriangle(v[0], v[1], v[2]);
+    }
+}
@@ -0,0 +1,131 @@
+/*
+ * MountainLOD.h: Header file for view-dependent, continuous level of detail
+ * for the mountain, in the style of ROAM.
+ *
+ */
+
+
+#ifndef _MOUNTAINLOD_H_
+#define _MOUNTAINLOD_H_
+
+#include <vector>
+#include <stdint.h>
+#include "MountainMesh.h"
+#include "MountainView.h"
+
+// Each base triangle is a right isosceles triangle, so it is the root of a
+// binary triangle tree: splitting a triangle through the midpoint of its
+// hypotenuse gives two smaller right isosceles triangles. Two tree levels
+// reach the same vertices as one level of uniform four-way subdivision, and
+// each new vertex gets its height from the same edge, seed and level as it
+// would there, so the refined surface matches Mountain::Subdivide exactly.
+//
+// Triangles are split and merged a few at a time each frame, in the order
+// given by two priority queues keyed on their projected error in pixels.
+// Splits follow the usual ROAM rule of splitting the base neighbor first, so
+// the mesh never has cracks.
+class MountainLOD {
+  private:
+    struct Triangle {
+	uint32_t    apex;	// The right-angle vertex.
+	uint32_t    left;	// The hypotenuse runs from left to right.
+	uint32_t    right;
+	int32_t	    left_nb;	// Neighbor across the apex-left leg.
+	int32_t	    right_nb;	// Neighbor across the apex-right leg.
+	int32_t	    base_nb;	// Neighbor across the hypotenuse.
+	int32_t	    parent;
+	int32_t	    child;	// First of two children, -1 for a leaf.
+	uint32_t    stamp;	// Bumped on every change. Stales queue entries.
+	uint8_t	    depth;
+	uint8_t	    root;	// Which base triangle this descends from.
+	bool	    alive;
+	float	    priority;	// Projected error, as of the last update.
+    };
+
+    struct QueueEntry {
+	float	    priority;
+	int32_t	    triangle;
+	uint32_t    stamp;
+    };
+
+    static const int	MAX_OPERATIONS_PER_FRAME;
+
+    // Heap orders: highest priority first to split, lowest first to merge.
+    static bool	SplitOrder(const QueueEntry &a, const QueueEntry &b)
+			{ return a.priority < b.priority; };
+    static bool	MergeOrder(const QueueEntry &a, const QueueEntry &b)
+			{ return a.priority > b.priority; };
+
+    std::vector<Triangle>   tris;
+    std::vector<int32_t>    free_pairs;	    // Unused child pairs.
+    int			    num_roots;
+    int			    num_leaves;
+    std::vector<float>	    root_diagonal;  // Sign of dx*dy along each
+					    // root's hypotenuse.
+
+    std::vector<float>	    x;		    // Vertex pool.
+    std::vector<float>	    y;
+    std::vector<float>	    z;
+    std::vector<uint32_t>   free_vertices;
+    std::vector<uint32_t>   out_index;	    // Extract's number for each
+					    // pool vertex.
+
+    uint64_t		    seed;
+    int			    max_depth;
+    std::vector<float>	    amplitude;	    // Displacement range per level.
+    std::vector<float>	    error_bound;    // Error below each depth.
+
+    int			    budget;	    // Target number of leaves.
+    float		    tolerance;	    // Acceptable error in pixels.
+
+    std::vector<QueueEntry> split_queue;    // Max-heap of leaves.
+    std::vector<QueueEntry> merge_queue;    // Min-heap of diamonds.
+
+    MountainView	    view;	    // Used to compute priorities.
+
+    uint32_t	NewVertex(float vx, float vy, float vz);
+    int32_t	NewPair(void);
+    uint32_t	Midpoint(int32_t t, int32_t b);
+    void	ReplaceNeighbor(int32_t n, int32_t old_nb, int32_t new_nb);
+    void	Split(int32_t t);
+    void	MergeOne(int32_t t);
+    void	Merge(int32_t t);
+    bool	Mergeable(int32_t t) const;
+    float	Priority(int32_t t) const;
+    float	DiamondPriority(int32_t t) const;
+    void	PushSplit(int32_t t);
+    void	PushMerge(int32_t t);
+    bool	TopSplit(QueueEntry &e);
+    bool	TopMerge(QueueEntry &e);
+    void	RebuildQueues(void);
+
+  public:
+    MountainLOD(void);
+
+    // Starts over from the base triangles, given as num_base sets of three
+    // x, y, z points with the right angle last. rand_start and rand_ratio
+    // are the displacement range of the first level and its decay per
+    // level, as used by uniform subdivision; max_level caps refinement at
+    // the detail of that many uniform levels.
+    void    Reset(const float base[][3][3], int num_base, uint64_t seed,
+		  float rand_start, float rand_ratio, int max_level);
+
+    // The number of triangles to aim for, and the projected error in
+    // pixels below which no more refinement is wanted.
+    void    SetBudget(int triangles) { budget = triangles; };
+    void    SetTolerance(float pixels) { tolerance = pixels; };
+
+    // Adjusts the mesh for the camera described by the column-major
+    // OpenGL modelview and projection matrices and the viewport. Returns
+    // true if the mesh changed.
+    bool    Update(const float modelview[16], const float projection[16],
+		   const int viewport[4]);
+
+    // Copies the current leaves, and only the vertices they use, into out.
+    void    Extract(MountainMesh &out);
+
+    int	    NumTriangles(void) const { return num_leaves; };
+};
+
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * MountainMesh.cpp: Indexed triangle storage for the mountain.
+ *
+ */
+
+
+#include "MountainMesh.h"
+#include "Parallel.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+const float MountainMesh::GRAY_BASE = 0.2f;
+const float MountainMesh::GRAY_HEIGHT = 80.0f;
+const uint32_t MountainMesh::NO_TWIN = 0xFFFFFFFFu;
+
+// Vertices or triangles handled by one parallel task.
+static const uint32_t	SHADING_TASK_SIZE = 65536;
+
+void
+MountainMesh::Clear(void)
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    indices.clear();
+    twins.clear();
+    nx.clear();
+    ny.clear();
+    nz.clear();
+    color.clear();
+    occlusion.clear();
+}
+
+
+void
+MountainMesh::Release(void)
+{
+    std::vector<float>().swap(x);
+    std::vector<float>().swap(y);
+    std::vector<float>().swap(z);
+    std::vector<uint32_t>().swap(indices);
+    std::vector<uint32_t>().swap(twins);
+    std::vector<float>().swap(nx);
+    std::vector<float>().swap(ny);
+    std::vector<float>().swap(nz);
+    std::vector<unsigned char>().swap(color);
+    std::vector<unsigned char>().swap(occlusion);
+}
+
+
+size_t
+MountainMesh::MemoryBytes(void) const
+{
+    return ( x.capacity() + y.capacity() + z.capacity() + nx.capacity()
+	     + ny.capacity() + nz.capacity() ) * sizeof(float)
+	   + ( indices.capacity() + twins.capacity() ) * sizeof(uint32_t)
+	   + color.capacity() + occlusion.capacity();
+}
+
+
+uint32_t
+MountainMesh::AddVertex(float px, float py, float pz)
+{
+    x.push_back(px);
+    y.push_back(py);
+    z.push_back(pz);
+    return (uint32_t)(x.size() - 1);
+}
+
+
+void
+MountainMesh::AddTriangle(uint32_t i1, uint32_t i2, uint32_t i3)
+{
+    //Only make triangle if there exists a point with z > 0
+    if(AboveGround(z[i1], z[i2], z[i3])){
+        indices.push_back(i1);
+        indices.push_back(i2);
+        indices.push_back(i3);
+    }
+}
+
+
+// Every half-edge is sorted by its edge, lower vertex first, so the
+// half-edges of an edge end up next to each other.
+void
+MountainMesh::LinkTwins(void)
+{
+    const uint32_t  num_half_edges = (uint32_t)indices.size();
+    std::vector<std::pair<uint64_t, uint32_t> >	edges(num_half_edges);
+
+    for ( uint32_t h = 0 ; h < num_half_edges ; h++ )
+    {
+	uint32_t    i1 = From(h), i2 = To(h);
+	uint64_t    lo = std::min(i1, i2), hi = std::max(i1, i2);
+	edges[h] = std::make_pair(( lo << 32 ) | hi, h);
+    }
+    std::sort(edges.begin(), edges.end());
+
+    twins.assign(num_half_edges, NO_TWIN);
+    for ( uint32_t k = 0 ; k < num_half_edges ; )
+    {
+	uint32_t    n = 1;
+	while ( k + n < num_half_edges && edges[k + n].first == edges[k].first )
+	    n++;
+	if ( n == 2 )
+	{
+	    uint32_t	a = edges[k].second, b = edges[k + 1].second;
+	    if ( From(a) == To(b) )
+	    {
+		twins[a] = b;
+		twins[b] = a;
+	    }
+	}
+	k += n;
+    }
+}
+
+
+// A vertex normal is the sum of the surface normals of the triangles around
+// it. Unnormalized cross products weight each triangle by its area. To sum
+// in parallel without races, and in the same order on every run, the
+// triangles around each vertex are first gathered into a compressed list,
+// sorted, and each vertex then sums its own list.
+void
+MountainMesh::ComputeShading(ShadingScratch &scratch)
+{
+    std::vector<float>	    &face = scratch.face;
+    std::vector<uint32_t>   &first = scratch.first;
+    std::vector<uint32_t>   &around = scratch.around;
+
+    const uint32_t  num_vertices = NumVertices();
+    const uint32_t  num_triangles = NumTriangles();
+    const uint32_t  *idx = indices.data();
+    const int	    vertex_tasks = (int)( num_vertices / SHADING_TASK_SIZE + 1 );
+    const int	    triangle_tasks = (int)( num_triangles / SHADING_TASK_SIZE + 1 );
+
+    // Surface normal of every triangle.
+    face.resize(num_triangles * 3);
+    ParallelFor(triangle_tasks, [&](int task) {
+	uint32_t    end = std::min(num_triangles, ( task + 1 ) * SHADING_TASK_SIZE);
+	for ( uint32_t t = task * SHADING_TASK_SIZE ; t < end ; t++ )
+	{
+	    uint32_t	i1 = idx[t*3], i2 = idx[t*3+1], i3 = idx[t*3+2];
+	    float   ux = x[i2] - x[i1], uy = y[i2] - y[i1], uz = z[i2] - z[i1];
+	    float   vx = x[i3] - x[i1], vy = y[i3] - y[i1], vz = z[i3] - z[i1];
+	    face[t*3] = uy*vz - uz*vy;
+	    face[t*3+1] = uz*vx - ux*vz;
+	    face[t*3+2] = ux*vy - uy*vx;
+	}
+    });
+
+    // Triangles around each vertex: count, offset, then fill.
+    if ( scratch.fill_capacity < num_vertices + 1 )
+    {
+	scratch.fill_capacity = num_vertices + 1 + num_vertices / 2;
+	scratch.fill.reset(new std::atomic<uint32_t>[scratch.fill_capacity]);
+    }
+    std::atomic<uint32_t>   *fill = scratch.fill.get();
+    ParallelFor(vertex_tasks, [&](int task) {
+	uint32_t    end = std::min(num_vertices + 1, ( task + 1 ) * SHADING_TASK_SIZE);
+	for ( uint32_t v = task * SHADING_TASK_SIZE ; v < end ; v++ )
+	    fill[v].store(0, std::memory_order_relaxed);
+    });
+    ParallelFor(triangle_tasks, [&](int task) {
+	uint32_t    end = std::min(num_triangles, ( task + 1 ) * SHADING_TASK_SIZE);
+	for ( uint32_t i = task * SHADING_TASK_SIZE * 3 ; i < end * 3 ; i++ )
+	    fill[idx[i]].fetch_add(1, std::memory_order_relaxed);
+    });
+    first.resize(num_vertices + 1);
+    uint32_t	running = 0;
+    for ( uint32_t v = 0 ; v < num_vertices ; v++ )
+    {
+	first[v] = running;
+	running += fill[v].load(std::memory_order_relaxed);
+	fill[v].store(first[v], std::memory_order_relaxed);
+    }
+    first[num_vertices] = running;
+
+    around.resize(running);
+    ParallelFor(triangle_tasks, [&](int task) {
+	uint32_t    end = std::min(num_triangles, ( task + 1 ) * SHADING_TASK_SIZE);
+	for ( uint32_t i = task * SHADING_TASK_SIZE * 3 ; i < end * 3 ; i++ )
+	    around[fill[idx[i]].fetch_add(1, std::memory_order_relaxed)] = i / 3;
+    });
+
+    // Sum and normalize each vertex's normal.
+    nx.resize(num_vertices);
+    ny.resize(num_vertices);
+    nz.resize(num_vertices);
+    ParallelFor(vertex_tasks, [&](int task) {
+	uint32_t    end = std::min(num_vertices, ( task + 1 ) * SHADING_TASK_SIZE);
+	for ( uint32_t v = task * SHADING_TASK_SIZE ; v < end ; v++ )
+	{
+	    uint32_t	*list = &around[0] + first[v];
+	    uint32_t	count = first[v + 1] - first[v];
+	    std::sort(list, list + count);
+
+	    float   sx = 0.0f, sy = 0.0f, sz = 0.0f;
+	    for ( uint32_t k = 0 ; k < count ; k++ )
+	    {
+		sx += face[list[k]*3];
+		sy += face[list[k]*3+1];
+		sz += face[list[k]*3+2];
+	    }
+	    float   len = sqrtf(sx*sx + sy*sy + sz*sz);
+	    if ( len > 0.0f )
+	    {
+		nx[v] = sx / len;
+		ny[v] = sy / len;
+		nz[v] = sz / len;
+	    }
+	    else
+	    {
+		// Unused or degenerate, so just point it up.
+		nx[v] = 0.0f;
+		ny[v] = 0.0f;
+		nz[v] = 1.0f;
+	    }
+	}
+    });
+
+    ComputeColors();
+}
+
+
+void
+MountainMesh::ComputeColors(void)
+{
+    const uint32_t  num_vertices = NumVertices();
+    const bool	    occluded = HasOcclusion();
+
+    color.resize(num_vertices * 4);
+    ParallelFor((int)( num_vertices / SHADING_TASK_SIZE + 1 ), [&](int task) {
+	uint32_t    end = std::min(num_vertices, ( task + 1 ) * SHADING_TASK_SIZE);
+	for ( uint32_t v = task * SHADING_TASK_SIZE ; v < end ; v++ )
+	{
+	    unsigned char   c = HeightGray(z[v]);
+	    unsigned char   a = occluded ? occlusion[v] : 255;
+	    c = (unsigned char)( ( c * a + 127 ) / 255 );
+	    color[v*4] = color[v*4+1] = color[v*4+2] = c;
+	    color[v*4+3] = a;
+	}
+    });
+}
+
+
+void
+MountainMesh::Interleave(MountainVertex *out) const
+{
+    const uint32_t  num_vertices = NumVertices();
+
+    ParallelFor((int)( num_vertices / SHADING_TASK_SIZE + 1 ), [&](int task) {
+	uint32_t    end = std::min(num_vertices, ( task + 1 ) * SHADING_TASK_SIZE);
+	for ( uint32_t i = task * SHADING_TASK_SIZE ; i < end ; i++ )
+	{
+	    MountainVertex  &v = out[i];
+	    v.position[0] = x[i];
+	    v.position[1] = y[i];
+	    v.position[2] = z[i];
+	    v.normal[0] = nx[i];
+	    v.normal[1] = ny[i];
+	    v.normal[2] = nz[i];
+	    memcpy(v.color, &color[i*4], 4);
+	}
+    });
+}
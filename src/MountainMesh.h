@@ -0,0 +1,140 @@
+/*
+ * MountainMesh.h: Header file for the indexed triangle mesh the mountain is
+ * built from.
+ *
+ */
+
+
+#ifndef _MOUNTAINMESH_H_
+#define _MOUNTAINMESH_H_
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+
+// The interleaved layout of one vertex, as drawn from a vertex buffer.
+struct MountainVertex {
+    float	    position[3];
+    float	    normal[3];
+    unsigned char   color[4];	// RGBA.
+};
+
+// Vertex positions are stored as three contiguous float arrays and every
+// triangle as three 32-bit indices into them. Passes over the mesh stream
+// through memory rather than chasing a heap pointer per point and triangle.
+//
+// Half-edge h is edge h % 3 of triangle h / 3, running from its vertex h % 3
+// to the next, so faces and the half-edges around them need no storage of
+// their own. Adjacency is one more array, the twin of each half-edge: the
+// half-edge running the other way along the same edge, in the triangle on
+// the other side. From any half-edge the neighboring triangle and its
+// far vertex are then one lookup away.
+//
+// Storage only grows until Release. Clearing a mesh, or swapping it with
+// another, keeps every array's capacity, so rebuilding a level of the same
+// size or smaller makes no calls to the allocator.
+class MountainMesh {
+  public:
+    std::vector<float>	    x;	    // Vertex positions, one entry per vertex.
+    std::vector<float>	    y;
+    std::vector<float>	    z;
+    std::vector<uint32_t>   indices;// Three vertex indices per triangle.
+    std::vector<uint32_t>   twins;  // Twin of each half-edge, or NO_TWIN on
+				    // the boundary. Empty if the mesh has no
+				    // adjacency, as when built by AddTriangle.
+
+    static const uint32_t   NO_TWIN;
+
+    // Shading, filled in by ComputeShading once the level is complete.
+    std::vector<float>	    nx;	    // Unit vertex normals.
+    std::vector<float>	    ny;
+    std::vector<float>	    nz;
+    std::vector<unsigned char>	color;	// RGBA, four bytes per vertex.
+    // Ambient light reaching each vertex, 255 for all of it. Baked by
+    // MountainOcclusion, or carried up from the level below by subdivision.
+    // Empty if neither, which is the same as all 255.
+    std::vector<unsigned char>	occlusion;
+
+    // Scratch space for ComputeShading. One can be shared by any number of
+    // meshes, and keeps its storage between calls.
+    class ShadingScratch {
+      private:
+	std::vector<float>	face;	// Surface normal of each triangle.
+	std::unique_ptr<std::atomic<uint32_t>[]> fill;	// Per-vertex counters.
+	uint32_t		fill_capacity;
+	std::vector<uint32_t>	first;	// Each vertex's list of triangles
+	std::vector<uint32_t>	around;	// starts at first, in around.
+
+	friend class MountainMesh;
+
+      public:
+	ShadingScratch(void) { fill_capacity = 0; };
+    };
+
+    // Removes all vertices and triangles in constant time. Keeps the
+    // allocated storage.
+    void    Clear(void);
+
+    uint32_t	NumVertices(void) const { return (uint32_t)x.size(); };
+    uint32_t	NumTriangles(void) const { return (uint32_t)(indices.size() / 3); };
+
+    // Appends a vertex and returns its index.
+    uint32_t	AddVertex(float px, float py, float pz);
+
+    // Appends a triangle, unless all three vertices are on or below the
+    // ground, where it would never be seen. Doesn't touch the twins.
+    void    AddTriangle(uint32_t i1, uint32_t i2, uint32_t i3);
+
+    // Half-edges around a triangle, and what they join.
+    static uint32_t Next(uint32_t h) { return h % 3 == 2 ? h - 2 : h + 1; };
+    static uint32_t Prev(uint32_t h) { return h % 3 == 0 ? h + 2 : h - 1; };
+    static uint32_t Face(uint32_t h) { return h / 3; };
+    uint32_t	From(uint32_t h) const { return indices[h]; };
+    uint32_t	To(uint32_t h) const { return indices[Next(h)]; };
+    uint32_t	Twin(uint32_t h) const { return twins[h]; };
+    bool	HasTwins(void) const { return twins.size() == indices.size(); };
+    bool	HasOcclusion(void) const { return occlusion.size() == x.size(); };
+
+    // Links the twins of every edge shared by exactly two triangles that
+    // run opposite ways along it, from the indices alone. Subdivide keeps
+    // them from one level to the next, so this is only needed once.
+    void    LinkTwins(void);
+
+    // Frees all storage.
+    void    Release(void);
+
+    // Bytes of storage currently held.
+    size_t  MemoryBytes(void) const;
+
+    // Computes smooth, area-weighted vertex normals and height-based
+    // colors for the whole mesh, in parallel.
+    void    ComputeShading(ShadingScratch &scratch);
+
+    // Recomputes just the colors, as ComputeShading does. Each is darkened
+    // by the vertex's occlusion, which is also kept in its alpha, so that
+    // drawing needs nothing more and the level's vertices carry it.
+    void    ComputeColors(void);
+
+    // Writes every vertex, with its shading, to out in the interleaved
+    // layout, in parallel.
+    void    Interleave(MountainVertex *out) const;
+
+    // The gray level of a vertex at height z, lighter with height: GRAY_BASE
+    // on the ground, rising by one for every GRAY_HEIGHT up, until white.
+    static const float	GRAY_BASE;
+    static const float	GRAY_HEIGHT;
+    static unsigned char HeightGray(float z)
+    {
+	float	gray = GRAY_BASE + z / GRAY_HEIGHT;
+	return (unsigned char)( gray > 1.0f ? 255 : gray * 255 );
+    };
+
+    // Whether a triangle with these vertex heights is worth keeping.
+    static bool AboveGround(float z1, float z2, float z3)
+	{ return z1 > 0 || z2 > 0 || z3 > 0; };
+};
+
+
+#endif
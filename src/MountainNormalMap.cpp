@@ -0,0 +1,144 @@
+/*
+ * MountainNormalMap.cpp: Baking normal maps of deep mountain levels.
+ *
+ * Texel (p, q) of a map is crossed by the diagonal lattice edge from
+ * sample (p+1, q) to sample (p, q+1), through its middle, so a row of
+ * texels is baked from the row of samples below it and the one above.
+ */
+
+
+#include "MountainNormalMap.h"
+#include <math.h>
+#include "Parallel.h"
+
+// Rows of texels baked by one parallel task. Each task samples one more
+// row than it bakes, so this keeps the samples done twice few.
+static const uint32_t	BAKE_TASK_ROWS = 64;
+
+
+// Makes row j of grid into vertices, with their smooth normals and grays.
+static void
+SampleRow(const MountainGrid &grid, uint32_t j, std::vector<MountainVertex> &row)
+{
+    for ( uint32_t i = 0 ; i + j <= grid.Steps() ; i++ )
+	grid.Sample(i, j, 1, row[i]);
+}
+
+
+void
+MountainNormalMap::Bake(const std::vector<MountainGrid> &grids, int coarse_level)
+{
+    numMaps = (int)grids.size();
+    level = numMaps ? grids[0].Level() : 0;
+    size = numMaps ? grids[0].Steps() : 0;
+    coarseLevel = std::min(coarse_level, level);
+    texels.resize((size_t)numMaps * size * size * 4);
+
+    int	blocks = (int)( ( size + BAKE_TASK_ROWS - 1 ) / BAKE_TASK_ROWS );
+    ParallelFor(numMaps * blocks, [&](int task) {
+	const MountainGrid  &grid = grids[task / blocks];
+	unsigned char	    *map = &texels[(size_t)( task / blocks ) * size * size * 4];
+	uint32_t	    first = (uint32_t)( task % blocks ) * BAKE_TASK_ROWS;
+	uint32_t	    end = std::min(size, first + BAKE_TASK_ROWS);
+	std::vector<MountainVertex> below(size + 1), above(size + 1);
+
+	SampleRow(grid, first, below);
+	for ( uint32_t q = first ; q < end ; q++ )
+	{
+	    SampleRow(grid, q + 1, above);
+	    unsigned char   *out = map + (size_t)q * size * 4;
+	    for ( uint32_t p = 0 ; p < size ; p++ )
+	    {
+		uint32_t		i = std::min(p, size - 1 - q);
+		const MountainVertex	&a = below[i + 1];
+		const MountainVertex	&b = above[i];
+		float	n[3];
+		for ( int k = 0 ; k < 3 ; k++ )
+		    n[k] = a.normal[k] + b.normal[k];
+		float	len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if ( len > 0.0f )
+		{
+		    for ( int k = 0 ; k < 3 ; k++ )
+			n[k] /= len;
+		}
+		else
+		{
+		    n[0] = n[1] = 0.0f;
+		    n[2] = 1.0f;
+		}
+		for ( int k = 0 ; k < 3 ; k++ )
+		    out[p * 4 + k] = (unsigned char)( n[k] * 127.5f + 128.0f );
+		out[p * 4 + 3] = (unsigned char)( ( a.color[0] + b.color[0] + 1 ) / 2 );
+	    }
+	    below.swap(above);
+	}
+    });
+
+    // The coarse lattice of every map, row by row as in the grids.
+    uint32_t	stride = (uint32_t)1 << ( level - coarseLevel );
+    uint32_t	steps = size / stride;
+    uint32_t	per_map = ( steps + 1 ) * ( steps + 2 ) / 2;
+    vertices.resize((size_t)numMaps * per_map);
+    indices.clear();
+    indices.reserve((size_t)numMaps * steps * steps * 3);
+    firsts.assign(1, 0);
+    for ( int m = 0 ; m < numMaps ; m++ )
+    {
+	MountainMapVertex   *v = &vertices[(size_t)m * per_map];
+	std::vector<uint32_t>	row_start(steps + 1);
+	uint32_t    count = 0;
+	for ( uint32_t j = 0 ; j <= steps ; j++ )
+	{
+	    row_start[j] = m * per_map + count;
+	    for ( uint32_t i = 0 ; i + j <= steps ; i++, count++ )
+	    {
+		v[count].position[0] = grids[m].Coordinate(0, i * stride, j * stride);
+		v[count].position[1] = grids[m].Coordinate(1, i * stride, j * stride);
+		v[count].position[2] = grids[m].Height(i * stride, j * stride);
+		v[count].texcoord[0] = (float)i / (float)steps;
+		v[count].texcoord[1] = (float)j / (float)steps;
+	    }
+	}
+	for ( uint32_t j = 0 ; j < steps ; j++ )
+	    for ( uint32_t i = 0 ; i + j < steps ; i++ )
+	    {
+		AddTriangle(row_start[j] + i + 1, row_start[j + 1] + i, row_start[j] + i);
+		if ( i + j + 2 <= steps )
+		    AddTriangle(row_start[j] + i + 1, row_start[j + 1] + i + 1,
+				row_start[j + 1] + i);
+	    }
+	firsts.push_back(indices.size());
+    }
+}
+
+
+void
+MountainNormalMap::AddTriangle(uint32_t a, uint32_t b, uint32_t c)
+{
+    if ( ! MountainMesh::AboveGround(vertices[a].position[2], vertices[b].position[2],
+				     vertices[c].position[2]) )
+	return;
+    indices.push_back(a);
+    indices.push_back(b);
+    indices.push_back(c);
+}
+
+
+size_t
+MountainNormalMap::MemoryBytes(void) const
+{
+    return texels.capacity()
+	 + vertices.capacity() * sizeof(struct MountainMapVertex)
+	 + indices.capacity() * sizeof(uint32_t)
+	 + firsts.capacity() * sizeof(size_t);
+}
+
+
+void
+MountainNormalMap::Release(void)
+{
+    std::vector<unsigned char>().swap(texels);
+    std::vector<MountainMapVertex>().swap(vertices);
+    std::vector<uint32_t>().swap(indices);
+    std::vector<size_t>().swap(firsts);
+}
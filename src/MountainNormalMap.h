@@ -0,0 +1,86 @@
+/*
+ * MountainNormalMap.h: Header file for the class that bakes the normals of
+ * a deep mountain level into maps drawn over a coarse one.
+ *
+ */
+
+
+#ifndef _MOUNTAINNORMALMAP_H_
+#define _MOUNTAINNORMALMAP_H_
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include "MountainGrid.h"
+
+// A vertex of the coarse mesh the maps are drawn on.
+struct MountainMapVertex {
+    float	position[3];
+    float	texcoord[2];	// Where it falls on its base triangle's map.
+};
+
+// One square map per base triangle, laid over the lattice of its grid: the
+// samples of a level with 2^level steps along a leg sit on the corners of
+// a map 2^level texels on a side, sample (i, j) at texel coordinates
+// (i, j), so the triangle covers the half of the map below its diagonal.
+// Each texel holds the normal in the middle of the lattice edge crossing
+// it, averaged from the smooth normals of its two ends, in object space
+// as x, y and z mapped from -1..1 to 0..255. A heightfield needs no
+// tangent frame, and that is what fixed-function dot product texturing
+// takes. Alpha holds the gray of the edge's height, so the color follows
+// the fine level too. Texels past the diagonal repeat the last one inside
+// their row, so filtering never pulls in anything that isn't surface.
+//
+// The coarse mesh keeps every 2^(level - coarse level)'th sample, at the
+// same place and height as the coarse level of the pyramid, and only
+// differs from it in being drawn with the map. Its triangles entirely on
+// the ground are left out, as they are everywhere else. Rows of texels are
+// baked in parallel.
+class MountainNormalMap {
+  private:
+    int		level;		// The level the normals come from.
+    int		coarseLevel;	// The level of the mesh they are drawn on.
+    uint32_t	size;		// Texels along a side of each map.
+    int		numMaps;
+    std::vector<unsigned char>	    texels;	// Every map, RGBA, row by row.
+    std::vector<MountainMapVertex>  vertices;	// Of every map's triangle.
+    std::vector<uint32_t>	    indices;	// Map by map.
+    std::vector<size_t>		    firsts;	// Where each map's indices
+						// start, and the last's end.
+
+    // Adds the triangle of vertices a, b and c, unless it lies flat on the
+    // ground.
+    void    AddTriangle(uint32_t a, uint32_t b, uint32_t c);
+
+  public:
+    MountainNormalMap(void) { level = coarseLevel = 0; size = 0; numMaps = 0; };
+
+    // Bakes a map from each of grids, which must all be at the same level,
+    // and the mesh of their lattices at coarse_level, or at their own
+    // level if that is coarser.
+    void    Bake(const std::vector<MountainGrid> &grids, int coarse_level);
+
+    int		Level(void) const { return level; };
+    int		CoarseLevel(void) const { return coarseLevel; };
+    uint32_t	Size(void) const { return size; };
+    int		NumMaps(void) const { return numMaps; };
+    // Map m, Size() rows of Size() RGBA texels.
+    const unsigned char	*Texels(int m) const
+		    { return texels.data() + (size_t)m * size * size * 4; };
+
+    const std::vector<MountainMapVertex>    &Vertices(void) const { return vertices; };
+    const std::vector<uint32_t>		    &Indices(void) const { return indices; };
+    // The triangles drawn with map m are the NumIndices(m) indices from
+    // FirstIndex(m) on. FirstIndex(NumMaps()) is the end of the last map's.
+    size_t	FirstIndex(int m) const { return firsts[m]; };
+    size_t	NumIndices(int m) const { return firsts[m + 1] - firsts[m]; };
+
+    // Bytes of storage currently held.
+    size_t  MemoryBytes(void) const;
+
+    // Frees all storage, once the maps and mesh have been copied out.
+    void    Release(void);
+};
+
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * MountainOcclusion.cpp: Baking ambient occlusion into mountain vertices.
+ *
+ */
+
+
+#include "MountainOcclusion.h"
+#include "MountainRandom.h"
+#include "Parallel.h"
+#include <math.h>
+
+// Enough for smooth gradients once interpolated across the triangles.
+const int MountainOcclusion::NUM_RAYS = 16;
+// About the height of a building, so valleys and the foot of a building are
+// darkened, but not a whole slope facing a distant peak.
+const float MountainOcclusion::MAX_DISTANCE = 10.0f;
+// Well above float rounding at the mountain's size, and well below the
+// smallest triangles the pyramid holds.
+const float MountainOcclusion::BIAS = 1e-3f;
+
+// Vertices handled by one parallel task.
+static const uint32_t	BAKE_TASK_SIZE = 4096;
+
+
+MountainOcclusion::MountainOcclusion(void)
+{
+    // A spiral of equal areas on the unit disk, lifted onto the hemisphere,
+    // spaces the directions evenly with density proportional to the cosine.
+    const float	golden = 3.14159265f * ( 3.0f - sqrtf(5.0f) );
+    rays.resize(NUM_RAYS * 3);
+    for ( int k = 0 ; k < NUM_RAYS ; k++ )
+    {
+	float	r = sqrtf(( k + 0.5f ) / NUM_RAYS);
+	rays[k*3] = r * cosf(golden * k);
+	rays[k*3+1] = r * sinf(golden * k);
+	rays[k*3+2] = sqrtf(1.0f - r * r);
+    }
+}
+
+
+void
+MountainOcclusion::SetSurface(const MountainMesh &mesh)
+{
+    surface.Build(mesh);
+}
+
+
+void
+MountainOcclusion::Bake(MountainMesh &mesh, const MountainIndex &occluders) const
+{
+    const uint32_t  num_vertices = mesh.NumVertices();
+
+    mesh.occlusion.resize(num_vertices);
+    ParallelFor((int)( ( num_vertices + BAKE_TASK_SIZE - 1 ) / BAKE_TASK_SIZE ), [&](int task) {
+	uint32_t    end = std::min(num_vertices, ( task + 1 ) * BAKE_TASK_SIZE);
+	for ( uint32_t v = task * BAKE_TASK_SIZE ; v < end ; v++ )
+	{
+	    float   n[3] = { mesh.nx[v], mesh.ny[v], mesh.nz[v] };
+	    float   o[3] = { mesh.x[v] + n[0] * BIAS, mesh.y[v] + n[1] * BIAS,
+			     mesh.z[v] + n[2] * BIAS };
+
+	    // Two axes at right angles to the normal, from Duff et al.'s
+	    // branchless construction, then turned by the vertex's angle.
+	    float   sign = copysignf(1.0f, n[2]);
+	    float   a = -1.0f / ( sign + n[2] );
+	    float   b = n[0] * n[1] * a;
+	    float   t1[3] = { 1.0f + sign * n[0] * n[0] * a, sign * b, -sign * n[0] };
+	    float   t2[3] = { b, sign + n[1] * n[1] * a, -n[1] };
+	    uint64_t	h = MountainRandom::Mix(MountainRandom::PointKey(mesh.x[v], mesh.y[v]));
+	    float   angle = (float)( h >> 40 ) * ( 6.28318531f / 16777216.0f );
+	    float   c = cosf(angle), s = sinf(angle);
+	    float   u[3], w[3];
+	    for ( int k = 0 ; k < 3 ; k++ )
+	    {
+		u[k] = c * t1[k] + s * t2[k];
+		w[k] = c * t2[k] - s * t1[k];
+	    }
+
+	    int	    open = 0;
+	    for ( int r = 0 ; r < NUM_RAYS ; r++ )
+	    {
+		const float *l = &rays[r * 3];
+		float	d[3];
+		for ( int k = 0 ; k < 3 ; k++ )
+		    d[k] = l[0] * u[k] + l[1] * w[k] + l[2] * n[k];
+		if ( ! surface.Occluded(o, d, MAX_DISTANCE)
+		     && ! occluders.Occluded(o, d, MAX_DISTANCE) )
+		    open++;
+	    }
+	    mesh.occlusion[v] = (unsigned char)( ( open * 255 + NUM_RAYS / 2 ) / NUM_RAYS );
+	}
+    });
+    mesh.ComputeColors();
+}
+
+
+void
+MountainOcclusion::Release(void)
+{
+    surface.Release();
+}
+
+
+size_t
+MountainOcclusion::MemoryBytes(void) const
+{
+    return rays.capacity() * sizeof(float) + surface.MemoryBytes();
+}
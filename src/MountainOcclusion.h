@@ -0,0 +1,57 @@
+/*
+ * MountainOcclusion.h: Header file for the class that bakes ambient
+ * occlusion into the vertices of a mountain level.
+ *
+ */
+
+
+#ifndef _MOUNTAINOCCLUSION_H_
+#define _MOUNTAINOCCLUSION_H_
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include "MountainMesh.h"
+#include "MountainIndex.h"
+
+// The occlusion of a vertex is the share of a cosine-weighted hemisphere of
+// rays about its normal that get MAX_DISTANCE away without meeting the
+// mountain or anything standing on it, so a vertex lit from every side
+// gets 255 and one at the bottom of a crevice much less. Rays are traced
+// through MountainIndex, whose quadtree of boxes over the level is the
+// bounding volume hierarchy they descend.
+//
+// Every vertex casts the same fixed set of directions, turned about its
+// normal by an angle hashed from its x and y, so neighbors sample
+// differently but a level always bakes to the same values. Vertices are
+// baked in parallel.
+class MountainOcclusion {
+  private:
+    static const int	NUM_RAYS;	// Rays cast from each vertex.
+    static const float	MAX_DISTANCE;	// Furthest anything still shades.
+    static const float	BIAS;		// How far off the surface rays start.
+
+    std::vector<float>	rays;	// Directions about +z, three floats each.
+    MountainIndex	surface;
+
+  public:
+    MountainOcclusion(void);
+
+    // Indexes the level that shades the meshes baked next. It is read in
+    // place, so it must not change while they are.
+    void    SetSurface(const MountainMesh &mesh);
+
+    // Fills in the occlusion of mesh, which must be shaded, from the
+    // surface and the occluders, and recolors it. mesh may be the surface
+    // itself, or a simplified version of it.
+    void    Bake(MountainMesh &mesh, const MountainIndex &occluders) const;
+
+    // Frees all storage but the directions.
+    void    Release(void);
+
+    // Bytes of storage currently held.
+    size_t  MemoryBytes(void) const;
+};
+
+
+#endif
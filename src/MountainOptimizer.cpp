@@ -0,0 +1,237 @@
+/*
+ * MountainOptimizer.cpp: Vertex cache and locality ordering for mountain
+ * levels.
+ *
+ */
+
+
+#include "MountainOptimizer.h"
+#include <algorithm>
+
+const int MountainOptimizer::CACHE_SIZE = 16;
+
+// Marks a vertex that hasn't been given a new number.
+static const uint32_t	UNMAPPED = 0xFFFFFFFFu;
+
+
+float
+MountainOptimizer::ACMR(const MountainMesh &mesh)
+{
+    const size_t	    num_indices = mesh.indices.size();
+    std::vector<uint32_t>   entered(mesh.NumVertices(), UNMAPPED);
+    uint32_t		    misses = 0;
+
+    if ( num_indices == 0 )
+	return 0.0f;
+
+    // A FIFO cache holds the vertices of the last CACHE_SIZE misses.
+    for ( size_t i = 0 ; i < num_indices ; i++ )
+    {
+	uint32_t    v = mesh.indices[i];
+	if ( entered[v] == UNMAPPED || misses - entered[v] >= (uint32_t)CACHE_SIZE )
+	    entered[v] = misses++;
+    }
+
+    return misses / (float)( num_indices / 3 );
+}
+
+
+void
+MountainOptimizer::Optimize(MountainMesh &mesh)
+{
+    if ( mesh.NumTriangles() == 0 )
+	return;
+
+    OrderTriangles(mesh);
+    mesh.indices.swap(reordered);
+    if ( mesh.HasTwins() )
+    {
+	// Triangles keep their corners in order, so only the triangle part
+	// of each half-edge changes.
+	twins.resize(mesh.twins.size());
+	for ( uint32_t h = 0 ; h < mesh.twins.size() ; h++ )
+	{
+	    uint32_t	t = mesh.twins[h];
+	    twins[placed[h / 3] * 3 + h % 3] = t == MountainMesh::NO_TWIN
+		? t : placed[t / 3] * 3 + t % 3;
+	}
+	mesh.twins.swap(twins);
+    }
+    OrderVertices(mesh);
+}
+
+
+// Tipsify, following the pseudocode in the paper. Time advances by one for
+// every cache miss, so a vertex is still cached while fewer than
+// CACHE_SIZE misses have happened since it was loaded.
+void
+MountainOptimizer::OrderTriangles(const MountainMesh &mesh)
+{
+    const uint32_t  num_vertices = mesh.NumVertices();
+    const uint32_t  num_triangles = mesh.NumTriangles();
+    const uint32_t  *idx = mesh.indices.data();
+    const uint32_t  k = (uint32_t)CACHE_SIZE;
+
+    // Triangles around each vertex.
+    live.assign(num_vertices, 0);
+    for ( uint32_t i = 0 ; i < num_triangles * 3 ; i++ )
+	live[idx[i]]++;
+    first.resize(num_vertices + 1);
+    uint32_t	running = 0;
+    for ( uint32_t v = 0 ; v < num_vertices ; v++ )
+    {
+	first[v] = running;
+	running += live[v];
+    }
+    first[num_vertices] = running;
+    around.resize(running);
+    for ( uint32_t i = 0 ; i < num_triangles * 3 ; i++ )
+	around[first[idx[i]+1] - live[idx[i]]--] = i / 3;
+    for ( uint32_t i = 0 ; i < num_triangles * 3 ; i++ )
+	live[idx[i]]++;
+
+    stamp.assign(num_vertices, 0);
+    placed.assign(num_triangles, UNMAPPED);
+    dead_end.clear();
+    reordered.resize(num_triangles * 3);
+
+    uint32_t	*out = reordered.data();
+    uint32_t	time = k + 1;
+    uint32_t	cursor = 0;	// Next vertex to try when stuck.
+    uint32_t	next = 0;	// Number of the next triangle emitted.
+    int64_t	fan = idx[0];
+
+    while ( fan >= 0 )
+    {
+	candidates.clear();
+
+	// Emit every remaining triangle around the fanning vertex.
+	for ( uint32_t a = first[fan] ; a < first[fan + 1] ; a++ )
+	{
+	    uint32_t	t = around[a];
+	    if ( placed[t] != UNMAPPED )
+		continue;
+	    for ( int c = 0 ; c < 3 ; c++ )
+	    {
+		uint32_t    v = idx[t*3+c];
+		*out++ = v;
+		dead_end.push_back(v);
+		candidates.push_back(v);
+		live[v]--;
+		if ( time - stamp[v] > k )
+		    stamp[v] = time++;
+	    }
+	    placed[t] = next++;
+	}
+
+	// Fan next around the candidate that will still be cached by the
+	// time its remaining triangles are emitted, and has been in the
+	// cache longest.
+	fan = -1;
+	int64_t	best = -1;
+	for ( size_t c = 0 ; c < candidates.size() ; c++ )
+	{
+	    uint32_t	v = candidates[c];
+	    if ( live[v] == 0 )
+		continue;
+	    int64_t	priority = 0;
+	    if ( time - stamp[v] + 2 * live[v] <= k )
+		priority = time - stamp[v];
+	    if ( priority > best )
+	    {
+		best = priority;
+		fan = v;
+	    }
+	}
+
+	// Otherwise go back to a recently used vertex that still has
+	// triangles, and failing that, the next vertex in input order that
+	// does.
+	while ( fan < 0 && ! dead_end.empty() )
+	{
+	    uint32_t	v = dead_end.back();
+	    dead_end.pop_back();
+	    if ( live[v] > 0 )
+		fan = v;
+	}
+	while ( fan < 0 && cursor < num_vertices )
+	{
+	    if ( live[cursor] > 0 )
+		fan = cursor;
+	    cursor++;
+	}
+    }
+}
+
+
+// Numbers vertices in the order the triangles first use them. Vertices no
+// triangle uses are dropped: they are the midpoints of edges whose
+// triangles were all culled for being below the ground.
+void
+MountainOptimizer::OrderVertices(MountainMesh &mesh)
+{
+    const uint32_t  num_vertices = mesh.NumVertices();
+    const size_t    num_indices = mesh.indices.size();
+    const bool	    occluded = mesh.HasOcclusion();
+    uint32_t	    next = 0;
+
+    remap.assign(num_vertices, UNMAPPED);
+    for ( size_t i = 0 ; i < num_indices ; i++ )
+    {
+	uint32_t    &v = mesh.indices[i];
+	if ( remap[v] == UNMAPPED )
+	    remap[v] = next++;
+	v = remap[v];
+    }
+
+    std::vector<float>	*arrays[3] = { &mesh.x, &mesh.y, &mesh.z };
+    temp.resize(next);
+    for ( int a = 0 ; a < 3 ; a++ )
+    {
+	std::vector<float>  &values = *arrays[a];
+	for ( uint32_t v = 0 ; v < num_vertices ; v++ )
+	    if ( remap[v] != UNMAPPED )
+		temp[remap[v]] = values[v];
+	values.swap(temp);
+	temp.resize(next);
+    }
+
+    // Occlusion carried up from the level below moves with its vertex.
+    if ( occluded )
+    {
+	temp_occlusion.resize(next);
+	for ( uint32_t v = 0 ; v < num_vertices ; v++ )
+	    if ( remap[v] != UNMAPPED )
+		temp_occlusion[remap[v]] = mesh.occlusion[v];
+	mesh.occlusion.swap(temp_occlusion);
+    }
+}
+
+
+void
+MountainOptimizer::Release(void)
+{
+    std::vector<uint32_t>().swap(first);
+    std::vector<uint32_t>().swap(around);
+    std::vector<uint32_t>().swap(live);
+    std::vector<uint32_t>().swap(stamp);
+    std::vector<uint32_t>().swap(dead_end);
+    std::vector<uint32_t>().swap(candidates);
+    std::vector<uint32_t>().swap(placed);
+    std::vector<uint32_t>().swap(reordered);
+    std::vector<uint32_t>().swap(twins);
+    std::vector<uint32_t>().swap(remap);
+    std::vector<float>().swap(temp);
+    std::vector<unsigned char>().swap(temp_occlusion);
+}
+
+
+size_t
+MountainOptimizer::MemoryBytes(void) const
+{
+    return ( first.capacity() + around.capacity() + live.capacity()
+	     + stamp.capacity() + dead_end.capacity() + candidates.capacity()
+	     + placed.capacity() + reordered.capacity() + twins.capacity()
+	     + remap.capacity() ) * sizeof(uint32_t)
+	   + temp.capacity() * sizeof(float) + temp_occlusion.capacity();
+}
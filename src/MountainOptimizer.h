@@ -0,0 +1,62 @@
+/*
+ * MountainOptimizer.h: Header file for the class that reorders a mountain
+ * level for the post-transform vertex cache and for memory locality.
+ *
+ */
+
+
+#ifndef _MOUNTAINOPTIMIZER_H_
+#define _MOUNTAINOPTIMIZER_H_
+
+#include <vector>
+#include "MountainMesh.h"
+
+// Triangles are put in the order given by Sander, Nehab and Barczak's
+// Tipsify, which fans around one vertex at a time, and moves on to a
+// vertex still in the modeled FIFO cache whenever it can. Vertices are then
+// renumbered in the order the triangles first use them, so vertex data is
+// read in nearly sequential order both by the GPU and by passes over the
+// triangles, such as computing normals. Vertices no triangle uses are
+// removed, so a level's storage grows with its visible surface. The shape
+// of the mesh is not changed, and twins are kept linked.
+class MountainOptimizer {
+  private:
+    static const int	CACHE_SIZE; // Vertices in the modeled cache.
+
+    std::vector<uint32_t>   first;	// Triangles around each vertex
+    std::vector<uint32_t>   around;	// start at first, in around.
+    std::vector<uint32_t>   live;	// Triangles around each vertex not
+					// yet emitted.
+    std::vector<uint32_t>   stamp;	// When each vertex entered the cache.
+    std::vector<uint32_t>   dead_end;	// Vertices of recent triangles.
+    std::vector<uint32_t>   candidates; // Vertices of the current fan.
+    std::vector<uint32_t>   placed;	// New number of each old triangle.
+    std::vector<uint32_t>   reordered;	// The new index list.
+    std::vector<uint32_t>   twins;	// And twins.
+    std::vector<uint32_t>   remap;	// New number of each old vertex.
+    std::vector<float>	    temp;	// For permuting vertex arrays.
+    std::vector<unsigned char>	temp_occlusion;	// And occlusion.
+
+    void    OrderTriangles(const MountainMesh &mesh);
+    void    OrderVertices(MountainMesh &mesh);
+
+  public:
+    // Reorders mesh's triangles, then its vertices, dropping unused ones.
+    // Must be called before ComputeShading, as it does not move normals or
+    // colors. Occlusion is moved.
+    void    Optimize(MountainMesh &mesh);
+
+    // The average number of vertices transformed per triangle when drawing
+    // the triangles in order through a FIFO cache of the modeled size.
+    // 0.5 is the ideal for a large grid, 3 the worst possible.
+    static float    ACMR(const MountainMesh &mesh);
+
+    // Frees the scratch storage kept between levels.
+    void    Release(void);
+
+    // Bytes of scratch storage currently held.
+    size_t  MemoryBytes(void) const;
+};
+
+
+#endif
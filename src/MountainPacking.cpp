@@ -0,0 +1,73 @@
+/*
+ * MountainPacking.cpp: Packing mountain vertices into 10 bytes.
+ *
+ */
+
+
+#include "MountainPacking.h"
+#include <math.h>
+
+// Packed positions stay within this many steps of the origin, which leaves
+// room for the origin being rounded to a step.
+static const float  MAX_STEPS = 32766.0f;
+
+
+float
+MountainPacking::Step(float extent)
+{
+    float   step = 1.0f / 65536.0f;
+    while ( extent * 0.5f > MAX_STEPS * step )
+	step *= 2.0f;
+    return step;
+}
+
+
+void
+MountainPacking::Fit(const float bounds[2][3], float s)
+{
+    step = s;
+    for ( int k = 0 ; k < 3 ; k++ )
+	origin[k] = roundf(( bounds[0][k] + bounds[1][k] ) * 0.5f / step) * step;
+}
+
+
+void
+MountainPacking::Pack(const std::vector<MountainVertex> &in,
+		      std::vector<MountainPackedVertex> &out) const
+{
+    out.resize(in.size());
+    for ( size_t i = 0 ; i < in.size() ; i++ )
+    {
+	for ( int k = 0 ; k < 3 ; k++ )
+	{
+	    // Rounded to a multiple of the step before the origin, which is
+	    // one, is taken off, so that a point packs to the same place from
+	    // every origin.
+	    float   p = floorf(in[i].position[k] / step + 0.5f) - origin[k] / step;
+	    out[i].position[k] = (int16_t)( p < -MAX_STEPS - 1.0f ? -MAX_STEPS - 1.0f
+					  : p > MAX_STEPS + 1.0f ? MAX_STEPS + 1.0f : p );
+	    out[i].normal[k] = (int8_t)roundf(in[i].normal[k] * 127.0f);
+	}
+	out[i].unused = 0;
+    }
+}
+
+
+void
+MountainPacking::Unpack(const MountainPackedVertex &in, MountainVertex &out) const
+{
+    float   len = 0.0f;
+    for ( int k = 0 ; k < 3 ; k++ )
+    {
+	out.position[k] = origin[k] + step * in.position[k];
+	out.normal[k] = in.normal[k];
+	len += out.normal[k] * out.normal[k];
+    }
+    len = sqrtf(len);
+    for ( int k = 0 ; k < 3 ; k++ )
+	out.normal[k] = len > 0.0f ? out.normal[k] / len : ( k == 2 ? 1.0f : 0.0f );
+
+    unsigned char   c = MountainMesh::HeightGray(out.position[2]);
+    out.color[0] = out.color[1] = out.color[2] = c;
+    out.color[3] = 255;
+}
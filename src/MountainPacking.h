@@ -0,0 +1,52 @@
+/*
+ * MountainPacking.h: Header file for the compact vertex format the mountain
+ * tiles are drawn from.
+ *
+ */
+
+
+#ifndef _MOUNTAINPACKING_H_
+#define _MOUNTAINPACKING_H_
+
+#include <vector>
+#include <stdint.h>
+#include "MountainMesh.h"
+
+// A vertex in 10 bytes rather than the 28 of a MountainVertex. Positions are
+// 16-bit steps from the middle of the tile, and normals are bytes, both of
+// which OpenGL takes as they are. There is no color, as the gray only
+// depends on height and can be looked up from it when drawing.
+struct MountainPackedVertex {
+    int16_t	position[3];
+    int8_t	normal[3];
+    int8_t	unused;
+};
+
+// The frame a tile's positions are packed in: a position is origin plus
+// step times its packed value, which the modelview matrix can do.
+class MountainPacking {
+  public:
+    float	origin[3];
+    float	step;
+
+    MountainPacking(void) { origin[0] = origin[1] = origin[2] = 0.0f; step = 1.0f; };
+
+    // The smallest power of two step that packs a box extent wide.
+    static float    Step(float extent);
+
+    // Centers the frame on the box with low and high corners bounds. Frames
+    // with the same step have their origins on multiples of it, so a point
+    // on the edge of two boxes packs to the same place in both, and tiles
+    // still meet without cracks.
+    void    Fit(const float bounds[2][3], float step);
+
+    void    Pack(const std::vector<MountainVertex> &in,
+		 std::vector<MountainPackedVertex> &out) const;
+
+    // What a packed vertex stands for, with its normal unit length and its
+    // color worked out from its height.
+    void    Unpack(const MountainPackedVertex &in, MountainVertex &out) const;
+};
+
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * MountainPackingTest.cpp: Checks the error of packing mountain tiles, with
+ * no window.
+ *
+ * Usage: mountain_packing_test
+ *
+ * Steps the grids to level 8 and cuts them into tiles as Mountain does,
+ * then packs every tile in its own frame, with one step for all of them.
+ * Each unpacked position must be within half a step of the real one, each
+ * normal within the angle that rounding its components to bytes allows,
+ * and a point shared by tiles must unpack to the same place from every one
+ * of them. Exits with the number of failed checks.
+ */
+
+
+#include <stdio.h>
+#include <math.h>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include "MountainGrid.h"
+#include "MountainTiles.h"
+#include "MountainPacking.h"
+#include "MountainParams.h"
+
+// The level stepped to, and the tiles it is cut into as Mountain cuts them.
+static const int	LEVEL = 8;
+static const int	TILE_LEVEL = 3;
+
+// Rounding each component of a unit normal to 1/127 moves it by at most
+// half of that in each, and so turns it through at most this angle.
+static const float	MAX_NORMAL_ANGLE = asinf(sqrtf(3.0f) * 0.5f / 127.0f);
+
+static int  failures = 0;
+
+
+int
+main(void)
+{
+    std::vector<MountainGrid>	grids(MountainParams::NUM_BASE_TRIANGLES);
+    std::vector<MountainGrid>	scratch(MountainParams::NUM_BASE_TRIANGLES);
+    float			range = MountainParams::BASE_RANGE;
+
+    for ( int g = 0 ; g < MountainParams::NUM_BASE_TRIANGLES ; g++ )
+	grids[g].Reset(MountainParams::BASE_TRIANGLES[g]);
+    for ( int l = 0 ; l < LEVEL ; l++ )
+    {
+	for ( int g = 0 ; g < MountainParams::NUM_BASE_TRIANGLES ; g++ )
+	    scratch[g].Subdivide(grids[g], 1, range);
+	grids.swap(scratch);
+	range *= MountainParams::RANGE_RATIO;
+    }
+
+    MountainTiles   tiles;
+    tiles.Build(grids, TILE_LEVEL);
+    float   extent = 0.0f;
+    for ( size_t t = 0 ; t < tiles.NumTiles() ; t++ )
+	for ( int k = 0 ; k < 3 && ! tiles.Tile(t).empty ; k++ )
+	    extent = std::max(extent, tiles.Tile(t).bounds[1][k] - tiles.Tile(t).bounds[0][k]);
+    float   step = MountainPacking::Step(extent);
+
+    // Where each point shared by tiles unpacked to in the first of them.
+    std::map<std::vector<float>, std::vector<float> >	unpacked;
+    std::vector<MountainVertex>	vertices;
+    std::vector<MountainPackedVertex>	packed;
+    std::vector<uint32_t>	strip;
+    float	worst_position = 0.0f, worst_angle = 0.0f;
+    uint32_t	num_vertices = 0, shared = 0, cracks = 0;
+    for ( size_t t = 0 ; t < tiles.NumTiles() ; t++ )
+    {
+	if ( tiles.Tile(t).empty )
+	    continue;
+	MountainPacking	packing;
+	tiles.Extract(grids, t, vertices, strip);
+	packing.Fit(tiles.Tile(t).bounds, step);
+	packing.Pack(vertices, packed);
+	for ( size_t v = 0 ; v < vertices.size() ; v++ )
+	{
+	    MountainVertex  out;
+	    packing.Unpack(packed[v], out);
+	    const float	*a = out.normal, *b = vertices[v].normal;
+	    float   cross[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+				 a[0] * b[1] - a[1] * b[0] };
+	    float   dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	    for ( int k = 0 ; k < 3 ; k++ )
+		worst_position = std::max(worst_position,
+					  fabsf(out.position[k] - vertices[v].position[k]));
+	    worst_angle = std::max(worst_angle, atan2f(sqrtf(cross[0] * cross[0]
+							     + cross[1] * cross[1]
+							     + cross[2] * cross[2]), dot));
+
+	    std::vector<float>	at(vertices[v].position, vertices[v].position + 3);
+	    std::vector<float>	to(out.position, out.position + 3);
+	    std::map<std::vector<float>, std::vector<float> >::iterator	i = unpacked.find(at);
+	    if ( i == unpacked.end() )
+		unpacked[at] = to;
+	    else
+	    {
+		shared++;
+		if ( i->second != to )
+		    cracks++;
+	    }
+	}
+	num_vertices += (uint32_t)vertices.size();
+    }
+
+    printf("step %g: %u vertices, worst position error %g, worst normal angle %g"
+	   " (bound %g), %u shared, %u cracks\n", step, num_vertices, worst_position,
+	   worst_angle, MAX_NORMAL_ANGLE, shared, cracks);
+    if ( ! num_vertices )
+    {
+	printf("FAIL nothing packed\n");
+	failures++;
+    }
+    if ( worst_position > step * 0.5f )
+    {
+	printf("FAIL position error over half a step\n");
+	failures++;
+    }
+    // The normals themselves are unit length only to float rounding.
+    if ( worst_angle > MAX_NORMAL_ANGLE + 1e-5f )
+    {
+	printf("FAIL normal angle over its bound\n");
+	failures++;
+    }
+    if ( ! shared || cracks )
+    {
+	printf("FAIL shared points pack differently\n");
+	failures++;
+    }
+
+    if ( ! failures )
+	printf("all passed\n");
+    return failures;
+}
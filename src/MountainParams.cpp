@@ -0,0 +1,27 @@
+/*
+ * MountainParams.cpp: The settings that decide what the mountain looks like.
+ *
+ */
+
+
+#include "MountainParams.h"
+
+const int MountainParams::NUM_BASE_TRIANGLES = 4;
+const float MountainParams::BASE_TRIANGLES[][3][3] = {
+    { { -20, 50, 0 }, { 50, -20, 0 }, { 50, 50, 50 } },
+    { { -10, -50, 0 }, { -50, -10, 0 }, { -50, -50, 20 } },
+    { { -50, 10, 0 }, { 10, 50, 0 }, { -50, 50, 20 } },
+    { { 50, 0, 0 }, { 0, -50, 0 }, { 50, -50, 40 } }
+};
+
+const float MountainParams::BASE_RANGE = 10;
+const float MountainParams::RANGE_RATIO = 0.6f;
+
+//Level 8 casts two million rays, about eight seconds of one core. Deeper
+//levels add little that would show, so they take their occlusion from it
+const int MountainParams::OCCLUSION_MAX_LEVEL = 8;
+
+//About the size of level 8. Deeper levels are simplified to it, unless
+//that would move the surface by more than a twentieth of a unit
+const uint32_t MountainParams::DECIMATE_BUDGET = 1 << 18;
+const float MountainParams::DECIMATE_TOLERANCE = 0.05f;
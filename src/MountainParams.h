@@ -0,0 +1,28 @@
+/*
+ * MountainParams.h: Header file for the settings that decide what the
+ * mountain looks like, shared by Mountain and the headless tools.
+ *
+ */
+
+
+#ifndef _MOUNTAINPARAMS_H_
+#define _MOUNTAINPARAMS_H_
+
+#include <stdint.h>
+
+// Kept apart from Mountain, which needs a GL context, so the benchmark and
+// tests build the same mountain the window shows.
+class MountainParams {
+  public:
+    static const int	NUM_BASE_TRIANGLES;	// The triangles each mountain
+    static const float	BASE_TRIANGLES[][3][3];	// starts out as.
+    static const float	BASE_RANGE;		// Displacement range of level 0.
+    static const float	RANGE_RATIO;		// Each level's range to the last.
+    static const int	OCCLUSION_MAX_LEVEL;	// Deepest level baked by rays.
+
+    static const uint32_t DECIMATE_BUDGET;	// Triangles to simplify to.
+    static const float	DECIMATE_TOLERANCE;	// Most error to accept doing it.
+};
+
+
+#endif
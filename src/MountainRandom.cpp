@@ -0,0 +1,15 @@
+/*
+ * MountainRandom.cpp: Counter-based random numbers for the mountain.
+ *
+ */
+
+
+#include "MountainRandom.h"
+
+
+float
+MountainRandom::EdgeUniform(uint64_t seed, int level,
+			    float x1, float y1, float x2, float y2)
+{
+    return KeyUniform(LevelKey(seed, level), PointKey(x1, y1), PointKey(x2, y2));
+}
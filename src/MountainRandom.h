@@ -0,0 +1,70 @@
+/*
+ * MountainRandom.h: Header file for the counter-based random numbers used
+ * to displace mountain midpoints.
+ *
+ */
+
+
+#ifndef _MOUNTAINRANDOM_H_
+#define _MOUNTAINRANDOM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+// There is no generator state. Each number is a SplitMix64 hash of the
+// mountain's seed, the subdivision level and the two endpoints of the edge
+// being split, so the value for an edge does not depend on when, or on
+// which thread, the edge is visited. Endpoints are identified by their x and
+// y, which subdivision never displaces, so the same edge gets the same
+// number no matter how its vertices happen to be numbered.
+class MountainRandom {
+  public:
+    // These are inline, as they run once or more for every new vertex.
+
+    // The SplitMix64 finalizer. A bijection with good avalanche behaviour.
+    static uint64_t Mix(uint64_t z)
+    {
+	z += 0x9E3779B97F4A7C15ull;
+	z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+	z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBull;
+	return z ^ ( z >> 31 );
+    };
+
+    // A key identifying the vertex at (x, y).
+    static uint64_t PointKey(float x, float y)
+    {
+	uint32_t    xbits, ybits;
+
+	// Adding zero turns -0 into +0, so both compare as the same point.
+	x += 0.0f;
+	y += 0.0f;
+	memcpy(&xbits, &x, sizeof(xbits));
+	memcpy(&ybits, &y, sizeof(ybits));
+	return ( (uint64_t)xbits << 32 ) | ybits;
+    };
+
+    // The part of the hash that depends only on the seed and level, for
+    // callers that draw many numbers at one level.
+    static uint64_t LevelKey(uint64_t seed, int level)
+	{ return Mix(seed ^ Mix((uint64_t)level)); };
+
+    // EdgeUniform for the points with keys k1 and k2, at the level with
+    // the given key.
+    static float    KeyUniform(uint64_t level_key, uint64_t k1, uint64_t k2)
+    {
+	uint64_t    lo = k1 < k2 ? k1 : k2;
+	uint64_t    hi = k1 < k2 ? k2 : k1;
+	uint64_t    h = Mix(Mix(level_key ^ lo) ^ hi);
+
+	// The top 24 bits fill a float mantissa exactly.
+	return (float)( h >> 40 ) * ( 1.0f / 16777216.0f );
+    };
+
+    // A uniform float in [0, 1) for the edge between (x1, y1) and (x2, y2)
+    // at the given level. The endpoints may be given in either order.
+    static float    EdgeUniform(uint64_t seed, int level,
+				float x1, float y1, float x2, float y2);
+};
+
+
+#endif
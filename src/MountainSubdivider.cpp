@@ -0,0 +1,274 @@
+/*
+ * MountainSubdivider.cpp: Parallel midpoint-displacement subdivision.
+ *
+ * Half-edges are numbered as in MountainMesh. An edge belongs to the lower
+ * of its two half-edges, or to its only one on the boundary. A level is
+ * built in phases separated by joins:
+ *
+ *   1. Count the owned edges in each band.
+ *   2. Create the midpoint of every owned edge, numbered in order.
+ *   3. Point every other half-edge at its twin's midpoint, note which
+ *	children of each triangle are above the ground, and count them in
+ *	each band.
+ *   4. Write the children, noting where each triangle's first one went.
+ *   5. Link the children's twins.
+ *
+ * Triangle p0 p1 p2 with midpoints m0 m1 m2, where mi is on the edge from
+ * pi, has children m0 m1 m2, then p0 m0 m2, m0 p1 m1 and m2 m1 p2, each left
+ * out if it is below the ground. Every bit of the result depends only on
+ * the input, so the output is the same however many threads build it.
+ */
+
+
+#include "MountainSubdivider.h"
+#include "MountainRandom.h"
+#include "Parallel.h"
+
+const int MountainSubdivider::MIN_BAND_TRIANGLES = 16384;
+
+// Where each edge of each child lies. An edge inside the parent gives the
+// child and edge on its other side. One along the parent gives the parent
+// edge it is half of, and which half: 0 from the start of that edge, 1 to
+// its end.
+struct ChildEdge {
+    int	    parent_edge;    // -1 inside the parent.
+    int	    half;
+    int	    child;
+    int	    edge;
+};
+
+static const ChildEdge	CHILD_EDGES[4][3] = {
+    { { -1, 0, 2, 2 }, { -1, 0, 3, 0 }, { -1, 0, 1, 1 } },
+    { { 0, 0, 0, 0 }, { -1, 0, 0, 2 }, { 2, 1, 0, 0 } },
+    { { 0, 1, 0, 0 }, { 1, 0, 0, 0 }, { -1, 0, 0, 0 } },
+    { { -1, 0, 0, 1 }, { 1, 1, 0, 0 }, { 2, 0, 0, 0 } }
+};
+
+// The child and edge making up each half of each parent edge.
+static const int	HALVES[3][2][2] = {
+    { { 1, 0 }, { 2, 0 } },
+    { { 2, 1 }, { 3, 1 } },
+    { { 3, 2 }, { 1, 2 } }
+};
+
+
+// Which children of a triangle with corners p and midpoints m are above
+// the ground, as bits.
+static uint8_t
+ChildrenAbove(const float *z, const uint32_t *p, const uint32_t *m)
+{
+    return (uint8_t)( MountainMesh::AboveGround(z[m[0]], z[m[1]], z[m[2]])
+		      | MountainMesh::AboveGround(z[p[0]], z[m[0]], z[m[2]]) << 1
+		      | MountainMesh::AboveGround(z[m[0]], z[p[1]], z[m[1]]) << 2
+		      | MountainMesh::AboveGround(z[m[2]], z[m[1]], z[p[2]]) << 3 );
+}
+
+
+uint32_t
+MountainSubdivider::BandBegin(int band, uint32_t num_triangles) const
+{
+    return (uint32_t)( (uint64_t)num_triangles * band / num_bands );
+}
+
+
+void
+MountainSubdivider::Subdivide(const MountainMesh &in, MountainMesh &out,
+			      uint64_t seed, int level, float rand_range)
+{
+    const uint32_t  num_vertices = in.NumVertices();
+    const uint32_t  num_triangles = in.NumTriangles();
+    const uint32_t  num_half_edges = num_triangles * 3;
+    const uint32_t  *idx = in.indices.data();
+    const uint32_t  *twin = in.twins.data();
+    const uint32_t  NO_TWIN = MountainMesh::NO_TWIN;
+
+    // Small levels run as one band on the calling thread.
+    num_bands = (int)( num_triangles / MIN_BAND_TRIANGLES );
+    num_bands = std::max(1, std::min(num_bands, NumThreads() * 4));
+
+    // 1. Owned edges per band, then the first new vertex of each band.
+    band_vertices.assign(num_bands + 1, 0);
+    ParallelFor(num_bands, [&](int b) {
+	uint32_t    count = 0;
+	for ( uint32_t h = BandBegin(b, num_triangles) * 3 ;
+	      h < BandBegin(b + 1, num_triangles) * 3 ; h++ )
+	    if ( twin[h] == NO_TWIN || twin[h] > h )
+		count++;
+	band_vertices[b] = count;
+    });
+    uint32_t	running = num_vertices;
+    for ( int b = 0 ; b <= num_bands ; b++ )
+    {
+	uint32_t    n = band_vertices[b];
+	band_vertices[b] = running;
+	running += n;
+    }
+
+    out.x.resize(running);
+    out.y.resize(running);
+    out.z.resize(running);
+    std::copy(in.x.begin(), in.x.end(), out.x.begin());
+    std::copy(in.y.begin(), in.y.end(), out.y.begin());
+    std::copy(in.z.begin(), in.z.end(), out.z.begin());
+    const bool	occluded = in.HasOcclusion();
+    if ( occluded )
+    {
+	out.occlusion.resize(running);
+	std::copy(in.occlusion.begin(), in.occlusion.end(), out.occlusion.begin());
+    }
+    else
+	out.occlusion.clear();
+
+    // 2. Create the midpoints.
+    midpoint.resize(num_half_edges);
+    ParallelFor(num_bands, [&](int b) {
+	uint32_t    next = band_vertices[b];
+	for ( uint32_t h = BandBegin(b, num_triangles) * 3 ;
+	      h < BandBegin(b + 1, num_triangles) * 3 ; h++ )
+	{
+	    if ( twin[h] != NO_TWIN && twin[h] < h )
+		continue;
+
+	    uint32_t	i1 = idx[h];
+	    uint32_t	i2 = idx[MountainMesh::Next(h)];
+
+	    // Written symmetrically so the result is the same from either
+	    // endpoint.
+	    float   x = ( in.x[i1] + in.x[i2] ) * 0.5f;
+	    float   y = ( in.y[i1] + in.y[i2] ) * 0.5f;
+	    float   z = ( in.z[i1] + in.z[i2] ) * 0.5f;
+
+	    // Leave points on the floor alone, which avoids artifacts at the
+	    // bottom of the mountain, and never push one below it.
+	    if ( z > 0 )
+	    {
+		float	random = MountainRandom::EdgeUniform(seed, level,
+				    in.x[i1], in.y[i1], in.x[i2], in.y[i2]);
+		z += -rand_range + random * ( 2 * rand_range );
+		if ( z < 0 )
+		    z = 0;
+	    }
+
+	    out.x[next] = x;
+	    out.y[next] = y;
+	    out.z[next] = z;
+	    if ( occluded )
+		out.occlusion[next] = (unsigned char)( ( in.occlusion[i1]
+							 + in.occlusion[i2] + 1 ) / 2 );
+	    midpoint[h] = next++;
+	}
+    });
+
+    // 3. Share owners' midpoints and count the children that survive.
+    band_triangles.assign(num_bands + 1, 0);
+    above.resize(num_triangles);
+    ParallelFor(num_bands, [&](int b) {
+	const float *z = out.z.data();
+	uint32_t    count = 0;
+	for ( uint32_t t = BandBegin(b, num_triangles) ;
+	      t < BandBegin(b + 1, num_triangles) ; t++ )
+	{
+	    for ( uint32_t h = t * 3 ; h < t * 3 + 3 ; h++ )
+		if ( twin[h] != NO_TWIN && twin[h] < h )
+		    midpoint[h] = midpoint[twin[h]];
+
+	    above[t] = ChildrenAbove(z, idx + t * 3, &midpoint[t * 3]);
+	    for ( int c = 0 ; c < 4 ; c++ )
+		count += ( above[t] >> c ) & 1;
+	}
+	band_triangles[b] = count;
+    });
+    running = 0;
+    for ( int b = 0 ; b <= num_bands ; b++ )
+    {
+	uint32_t    n = band_triangles[b];
+	band_triangles[b] = running;
+	running += n;
+    }
+
+    // 4. Emit the children in the same order a serial pass would.
+    out.indices.resize(running * 3);
+    first_child.resize(num_triangles);
+    ParallelFor(num_bands, [&](int b) {
+	uint32_t    next = band_triangles[b];
+	for ( uint32_t t = BandBegin(b, num_triangles) ;
+	      t < BandBegin(b + 1, num_triangles) ; t++ )
+	{
+	    const uint32_t  *p = idx + t * 3;
+	    const uint32_t  *m = &midpoint[t * 3];
+	    const uint32_t  child[4][3] = {
+		{ m[0], m[1], m[2] },
+		{ p[0], m[0], m[2] },
+		{ m[0], p[1], m[1] },
+		{ m[2], m[1], p[2] }
+	    };
+	    first_child[t] = next;
+	    for ( int c = 0 ; c < 4 ; c++ )
+		if ( above[t] >> c & 1 )
+		{
+		    uint32_t	*o = &out.indices[next++ * 3];
+		    o[0] = child[c][0];
+		    o[1] = child[c][1];
+		    o[2] = child[c][2];
+		}
+	}
+    });
+
+    // 5. Link the children. A half of a parent edge is the twin of the
+    // other half of the parent's twin, as the two run opposite ways.
+    out.twins.resize(running * 3);
+    ParallelFor(num_bands, [&](int b) {
+	// The child c of triangle t as a triangle of out, or NO_TWIN if it
+	// was left out.
+	auto	child_triangle = [&](uint32_t t, int c) -> uint32_t {
+	    if ( ! ( above[t] >> c & 1 ) )
+		return NO_TWIN;
+	    uint32_t	n = first_child[t];
+	    for ( int k = 0 ; k < c ; k++ )
+		n += ( above[t] >> k ) & 1;
+	    return n;
+	};
+
+	for ( uint32_t t = BandBegin(b, num_triangles) ;
+	      t < BandBegin(b + 1, num_triangles) ; t++ )
+	    for ( int c = 0 ; c < 4 ; c++ )
+	    {
+		uint32_t    n = child_triangle(t, c);
+		if ( n == NO_TWIN )
+		    continue;
+		for ( int k = 0 ; k < 3 ; k++ )
+		{
+		    const ChildEdge &e = CHILD_EDGES[c][k];
+		    uint32_t	    other = NO_TWIN;
+		    int		    edge = e.edge;
+		    if ( e.parent_edge < 0 )
+			other = child_triangle(t, e.child);
+		    else if ( twin[t * 3 + e.parent_edge] != NO_TWIN )
+		    {
+			uint32_t    h = twin[t * 3 + e.parent_edge];
+			const int   *half = HALVES[h % 3][1 - e.half];
+			other = child_triangle(h / 3, half[0]);
+			edge = half[1];
+		    }
+		    out.twins[n * 3 + k] = other == NO_TWIN ? NO_TWIN : other * 3 + edge;
+		}
+	    }
+    });
+}
+
+
+void
+MountainSubdivider::Release(void)
+{
+    std::vector<uint32_t>().swap(midpoint);
+    std::vector<uint32_t>().swap(first_child);
+    std::vector<uint8_t>().swap(above);
+}
+
+
+size_t
+MountainSubdivider::MemoryBytes(void) const
+{
+    return ( midpoint.capacity() + first_child.capacity() ) * sizeof(uint32_t)
+	   + above.capacity();
+}
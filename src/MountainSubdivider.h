@@ -0,0 +1,56 @@
+/*
+ * MountainSubdivider.h: Header file for the class that performs one level of
+ * midpoint-displacement subdivision on a mountain mesh, using all cores.
+ *
+ */
+
+
+#ifndef _MOUNTAINSUBDIVIDER_H_
+#define _MOUNTAINSUBDIVIDER_H_
+
+#include <vector>
+#include "MountainMesh.h"
+
+// Produces exactly the mesh a serial pass would: midpoints are numbered in
+// the order their edges are first met walking the triangles in order, and
+// children are emitted in triangle order. Each edge is identified by its
+// lower half-edge, which the twins give directly, so no table of edges is
+// built. Prefix sums over bands of triangles then give every thread its
+// own, preallocated range of new vertices and triangles to write. The twins
+// of the children follow from the parents' twins, so the output comes with
+// its adjacency, ready for the next level.
+class MountainSubdivider {
+  private:
+    static const int	MIN_BAND_TRIANGLES; // Smallest band worth a thread.
+
+    int	    num_bands;	    // Contiguous ranges of input triangles.
+
+    std::vector<uint32_t>   midpoint;	// Midpoint vertex of each half-edge.
+    std::vector<uint32_t>   first_child;// First child of each triangle.
+    std::vector<uint8_t>    above;	// Its children above the ground.
+    std::vector<uint32_t>   band_vertices;  // New vertices per band, then
+					    // the first one of each band.
+    std::vector<uint32_t>   band_triangles; // Same for child triangles.
+
+    uint32_t	BandBegin(int band, uint32_t num_triangles) const;
+
+  public:
+    MountainSubdivider(void) { num_bands = 1; };
+
+    // Splits every triangle of in into four, displacing each new midpoint
+    // above the ground by up to +- rand_range. Writes the result to out,
+    // which must be a different mesh, with its twins. The twins of in must
+    // be linked. Occlusion, if in has it, is carried over, each midpoint
+    // getting the average of its edge's.
+    void    Subdivide(const MountainMesh &in, MountainMesh &out,
+		      uint64_t seed, int level, float rand_range);
+
+    // Frees the scratch storage kept between levels.
+    void    Release(void);
+
+    // Bytes of scratch storage currently held.
+    size_t  MemoryBytes(void) const;
+};
+
+
+#endif
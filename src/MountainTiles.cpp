@@ -0,0 +1,352 @@
+/*
+ * MountainTiles.cpp: The mountain grids cut into tiles.
+ *
+ * Within a tile, samples are numbered by their steps (i, j) from its right
+ * angle, at the tile's level of detail, in rows as in a grid.
+ */
+
+
+#include "MountainTiles.h"
+#include "MountainBlocks.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "Parallel.h"
+
+
+// Appends the visible triangles of a strip of num_triangles triangles, whose
+// t'th vertex is vertex(t) and whose k'th triangle is wanted if visible(k).
+// Each run is joined on to what came before with degenerate triangles, and
+// starts on a position with the parity it had in the full strip, so its
+// triangles keep their winding.
+template <class Vertex, class Visible>
+static void
+AppendRuns(std::vector<uint32_t> &strip, uint32_t num_triangles,
+	   const Vertex &vertex, const Visible &visible)
+{
+    uint32_t	k = 0;
+    while ( k < num_triangles )
+    {
+	if ( ! visible(k) )
+	{
+	    k++;
+	    continue;
+	}
+	uint32_t    begin = k;
+	while ( k < num_triangles && visible(k) )
+	    k++;
+
+	uint32_t    first = vertex(begin);
+	if ( ! strip.empty() )
+	{
+	    strip.push_back(strip.back());
+	    strip.push_back(first);
+	}
+	if ( strip.size() % 2 != begin % 2 )
+	    strip.push_back(first);
+	for ( uint32_t t = begin ; t < k + 2 ; t++ )
+	    strip.push_back(vertex(t));
+    }
+}
+
+
+void
+MountainTiles::Build(const std::vector<MountainGrid> &grids, int tile_level)
+{
+    tiles.clear();
+    for ( size_t g = 0 ; g < grids.size() ; g++ )
+    {
+	int	    level = std::min(tile_level, grids[g].Level());
+	uint32_t    per_leg = 1u << level;
+	uint32_t    steps = grids[g].Steps() >> level;
+
+	// Row b of tiles has per_leg - b upright tiles, with the turned ones
+	// in the gaps between them. Where each went is kept to find neighbors.
+	std::vector<int>    upright(per_leg * per_leg, -1);
+	std::vector<int>    turned(per_leg * per_leg, -1);
+	for ( uint32_t b = 0 ; b < per_leg ; b++ )
+	    for ( uint32_t a = 0 ; a + b < per_leg ; a++ )
+	    {
+		MountainTile	tile;
+		tile.grid = (int)g;
+		tile.steps = steps;
+		tile.empty = true;	// Until measured.
+		memset(tile.bounds, 0, sizeof(tile.bounds));
+		tile.visible = false;
+		tile.detail = 0;
+		for ( int e = 0 ; e < 3 ; e++ )
+		{
+		    tile.neighbor[e] = -1;
+		    tile.edge_detail[e] = 0;
+		}
+		tile.version = 0;
+
+		tile.origin[0] = a * steps;
+		tile.origin[1] = b * steps;
+		tile.sign = 1;
+		upright[b * per_leg + a] = (int)tiles.size();
+		tiles.push_back(tile);
+
+		if ( a + b + 2 <= per_leg )
+		{
+		    tile.origin[0] = ( a + 1 ) * steps;
+		    tile.origin[1] = ( b + 1 ) * steps;
+		    tile.sign = -1;
+		    turned[b * per_leg + a] = (int)tiles.size();
+		    tiles.push_back(tile);
+		}
+	    }
+
+	// The turned tile (a, b) fills the gap between upright tiles (a, b),
+	// (a + 1, b) and (a, b + 1), and has no other neighbors.
+	for ( uint32_t b = 0 ; b < per_leg ; b++ )
+	    for ( uint32_t a = 0 ; a + b + 2 <= per_leg ; a++ )
+	    {
+		int	t = turned[b * per_leg + a];
+		int	below = upright[b * per_leg + a];
+		int	right = upright[b * per_leg + a + 1];
+		int	above = upright[( b + 1 ) * per_leg + a];
+		tiles[t].neighbor[0] = above;
+		tiles[t].neighbor[1] = below;
+		tiles[t].neighbor[2] = right;
+		tiles[above].neighbor[0] = t;
+		tiles[below].neighbor[1] = t;
+		tiles[right].neighbor[2] = t;
+	    }
+    }
+
+    ParallelFor((int)tiles.size(), [&](int t) {
+	Measure(grids[tiles[t].grid], tiles[t]);
+    });
+}
+
+
+void
+MountainTiles::Build(const MountainBlocks &blocks)
+{
+    tiles.clear();
+    for ( uint32_t b = 0 ; b < blocks.NumBlocks() ; b++ )
+    {
+	const MountainBlocks::Record	&r = blocks.Block(b);
+	MountainTile			tile;
+	tile.grid = r.grid;
+	tile.origin[0] = r.origin[0];
+	tile.origin[1] = r.origin[1];
+	tile.sign = r.sign;
+	tile.steps = blocks.BlockSteps();
+	tile.empty = r.empty != 0;
+	memcpy(tile.bounds, r.bounds, sizeof(tile.bounds));
+	tile.error.assign(r.error, r.error + blocks.Level() - blocks.BlockLevel() + 1);
+	tile.visible = false;
+	tile.detail = 0;
+	for ( int e = 0 ; e < 3 ; e++ )
+	{
+	    tile.neighbor[e] = r.neighbor[e];
+	    tile.edge_detail[e] = 0;
+	}
+	tile.version = 0;
+	tiles.push_back(tile);
+    }
+}
+
+
+void
+MountainTiles::Measure(const MountainGrid &grid, MountainTile &tile)
+{
+    const uint32_t  steps = tile.steps;
+    auto	    height = [&](uint32_t i, uint32_t j) {
+	return grid.Height(tile.origin[0] + tile.sign * (int)i,
+			   tile.origin[1] + tile.sign * (int)j);
+    };
+
+    int	    num_details = 0;
+    while ( ( 1u << num_details ) < steps )
+	num_details++;
+
+    // Every sample first appears as the midpoint of an edge of the lattice
+    // twice as coarse, so the error of keeping every 2^d'th sample is at
+    // least how far the samples added since then lie off those edges.
+    tile.error.assign(num_details + 1, 0.0f);
+    for ( int d = 1 ; d <= num_details ; d++ )
+    {
+	uint32_t    h = 1u << ( d - 1 );
+	uint32_t    m = steps >> ( d - 1 );
+	float	    worst = 0.0f;
+	for ( uint32_t q = 0 ; q <= m ; q++ )
+	    for ( uint32_t p = ( q % 2 == 0 ) ? 1 : 0 ; p + q <= m ;
+		  p += ( q % 2 == 0 ) ? 2 : 1 )
+	    {
+		uint32_t    i = p * h, j = q * h;
+		float	    ends;
+		if ( q % 2 == 0 )
+		    ends = height(i - h, j) + height(i + h, j);
+		else if ( p % 2 == 0 )
+		    ends = height(i, j - h) + height(i, j + h);
+		else
+		    ends = height(i + h, j - h) + height(i - h, j + h);
+		worst = std::max(worst, fabsf(height(i, j) - ends * 0.5f));
+	    }
+	tile.error[d] = std::max(tile.error[d - 1], worst);
+    }
+
+    float   zmin = height(0, 0), zmax = zmin;
+    for ( uint32_t j = 0 ; j <= steps ; j++ )
+	for ( uint32_t i = 0 ; i + j <= steps ; i++ )
+	{
+	    float   z = height(i, j);
+	    zmin = std::min(zmin, z);
+	    zmax = std::max(zmax, z);
+	}
+    tile.empty = zmax <= 0;
+
+    uint32_t	corners[3][2] = { { 0, 0 }, { steps, 0 }, { 0, steps } };
+    for ( int k = 0 ; k < 2 ; k++ )
+    {
+	tile.bounds[0][k] = tile.bounds[1][k] =
+	    grid.Coordinate(k, tile.origin[0], tile.origin[1]);
+	for ( int c = 1 ; c < 3 ; c++ )
+	{
+	    float   v = grid.Coordinate(k, tile.origin[0] + tile.sign * (int)corners[c][0],
+					tile.origin[1] + tile.sign * (int)corners[c][1]);
+	    tile.bounds[0][k] = std::min(tile.bounds[0][k], v);
+	    tile.bounds[1][k] = std::max(tile.bounds[1][k], v);
+	}
+    }
+    tile.bounds[0][2] = zmin;
+    tile.bounds[1][2] = zmax;
+}
+
+
+void
+MountainTiles::Select(const float modelview[16], const float projection[16],
+		      const int viewport[4], float tolerance)
+{
+    view.Set(modelview, projection, viewport);
+
+    // Tiles out of view get a detail too, so that the ones in view next to
+    // them meet them where they will be drawn once they come into view.
+    std::vector<int>	details(tiles.size());
+    for ( size_t t = 0 ; t < tiles.size() ; t++ )
+    {
+	MountainTile	&tile = tiles[t];
+	tile.visible = ! tile.empty && view.BoxVisible(tile.bounds);
+	details[t] = tile.detail;
+	if ( tile.empty )
+	    continue;
+
+	float	dist = view.BoxDistance(tile.bounds);
+	if ( dist < 0.1f )
+	    dist = 0.1f;
+	int	d = (int)tile.error.size() - 1;
+	while ( d > 0 && tile.error[d] * view.pixel_scale / dist > tolerance )
+	    d--;
+	details[t] = d;
+    }
+
+    for ( size_t t = 0 ; t < tiles.size() ; t++ )
+    {
+	MountainTile	&tile = tiles[t];
+	bool		changed = tile.detail != details[t];
+	tile.detail = details[t];
+	for ( int e = 0 ; e < 3 ; e++ )
+	{
+	    int	n = tile.neighbor[e];
+	    int	d = tile.detail;
+	    if ( n >= 0 && ! tiles[n].empty )
+		d = std::max(d, details[n]);
+	    changed = changed || tile.edge_detail[e] != d;
+	    tile.edge_detail[e] = d;
+	}
+	if ( changed )
+	    tile.version++;
+    }
+}
+
+
+// Extract, for a tile of lattice, which is a MountainGrid or a
+// MountainBlocks::Lattice.
+template <class Lattice>
+static void
+ExtractTile(const Lattice &lattice, const MountainTile &tile,
+	    std::vector<MountainVertex> &vertices, std::vector<uint32_t> &strip)
+{
+    const uint32_t	stride = 1u << tile.detail;
+    const uint32_t	m = tile.steps >> tile.detail;
+    auto		index = [&](uint32_t i, uint32_t j) {
+	return j * ( m + 1 ) - j * ( j - 1 ) / 2 + i;
+    };
+    auto		height = [&](uint32_t v) { return vertices[v].position[2]; };
+
+    vertices.resize(( m + 1 ) * ( m + 2 ) / 2);
+    ParallelFor((int)m + 1, [&](int row) {
+	uint32_t    j = (uint32_t)row;
+	for ( uint32_t i = 0 ; i + j <= m ; i++ )
+	    lattice.Sample(tile.origin[0] + tile.sign * (int)( i * stride ),
+			tile.origin[1] + tile.sign * (int)( j * stride ),
+			stride, vertices[index(i, j)]);
+    });
+
+    // Along an edge where the neighbor is coarser, the samples it doesn't
+    // have are moved onto the line between the ones it does, which is the
+    // edge it draws. Normals and colors are blended the same way, so the
+    // shading doesn't jump across the edge either.
+    for ( int e = 0 ; e < 3 ; e++ )
+    {
+	if ( tile.edge_detail[e] <= tile.detail )
+	    continue;
+	uint32_t    coarse = 1u << ( tile.edge_detail[e] - tile.detail );
+	auto	    edge = [&](uint32_t p) -> MountainVertex & {
+	    return vertices[e == 0 ? index(p, 0) : e == 1 ? index(m - p, p) : index(0, m - p)];
+	};
+	for ( uint32_t p = 0 ; p < m ; p++ )
+	{
+	    if ( p % coarse == 0 )
+		continue;
+	    uint32_t		a = p - p % coarse;
+	    const MountainVertex &va = edge(a);
+	    const MountainVertex &vb = edge(a + coarse);
+	    MountainVertex	&v = edge(p);
+	    float		f = (float)( p - a ) / (float)coarse;
+	    v.position[2] = va.position[2] + ( vb.position[2] - va.position[2] ) * f;
+	    for ( int k = 0 ; k < 3 ; k++ )
+		v.normal[k] = va.normal[k] + ( vb.normal[k] - va.normal[k] ) * f;
+	    for ( int k = 0 ; k < 4 ; k++ )
+		v.color[k] = (unsigned char)( va.color[k] + ( vb.color[k] - va.color[k] ) * f + 0.5f );
+	}
+    }
+
+    // Rows j and j + 1 make one strip, walked from the end of the rows back
+    // to the leg so that even triangles have the mesh winding: strip vertex
+    // t is sample (last - t/2, j) for even t and (last - (t+1)/2, j + 1)
+    // for odd t, where last is the last sample of row j.
+    strip.clear();
+    for ( uint32_t j = 0 ; j < m ; j++ )
+    {
+	uint32_t    last = m - j;
+	auto	    vertex = [&](uint32_t s) {
+	    return index(last - ( s + 1 ) / 2, j + s % 2);
+	};
+	AppendRuns(strip, 2 * last - 1, vertex, [&](uint32_t k) {
+	    return MountainMesh::AboveGround(height(vertex(k)), height(vertex(k + 1)),
+					     height(vertex(k + 2)));
+	});
+    }
+}
+
+
+void
+MountainTiles::Extract(const std::vector<MountainGrid> &grids, size_t t,
+		       std::vector<MountainVertex> &vertices,
+		       std::vector<uint32_t> &strip) const
+{
+    ExtractTile(grids[tiles[t].grid], tiles[t], vertices, strip);
+}
+
+
+void
+MountainTiles::Extract(const MountainBlocks &blocks, size_t t,
+		       std::vector<MountainVertex> &vertices,
+		       std::vector<uint32_t> &strip) const
+{
+    ExtractTile(blocks.Grid(tiles[t].grid), tiles[t], vertices, strip);
+}
@@ -0,0 +1,91 @@
+/*
+ * MountainTiles.h: Header file for cutting the mountain grids into tiles
+ * that are culled and refined one at a time.
+ *
+ */
+
+
+#ifndef _MOUNTAINTILES_H_
+#define _MOUNTAINTILES_H_
+
+#include <vector>
+#include <stdint.h>
+#include "MountainGrid.h"
+#include "MountainView.h"
+
+class MountainBlocks;
+
+// A triangular piece of a grid: the samples origin + sign * (i, j) for
+// i + j <= steps. Tiles with sign -1 are turned half way round, which keeps
+// their winding, so every tile is drawn the same way.
+struct MountainTile {
+    int		grid;		// The grid it is cut from.
+    uint32_t	origin[2];	// Lattice sample at its right angle.
+    int		sign;
+    uint32_t	steps;		// Lattice steps along a leg.
+    int		neighbor[3];	// The tile across each edge, or -1 on the edge
+				// of the grid. The edges run from the right
+				// angle to the first corner, to the second, and
+				// back.
+    bool	empty;		// Entirely on the ground.
+    float	bounds[2][3];	// Low and high corners of a box around it.
+    std::vector<float>	error;	// Most height error when only every
+				// 2^d'th sample is kept, for each d.
+
+    // Chosen for the view by Select.
+    bool	visible;
+    int		detail;		// Only every 2^detail'th sample is drawn.
+    int		edge_detail[3];	// The coarser of its and its neighbor's.
+    uint32_t	version;	// Bumped when any of the details change.
+};
+
+// Each grid is cut into the 4^tile_level triangles of that many levels of
+// uniform subdivision, so tiles are the same shape as the grid and line up
+// with its lattice. A tile's level of detail is chosen on its own, by how
+// far the error of dropping samples would show on the screen.
+//
+// Where neighbors differ in detail, the finer one moves the edge vertices the
+// coarser one doesn't have onto the coarser one's edge, so the two meet
+// without cracks. A tile has to be extracted again when that changes, which
+// its version tracks.
+class MountainTiles {
+  private:
+    std::vector<MountainTile>	tiles;
+    MountainView		view;
+
+  public:
+    // Cuts the grids into tiles, and works out their neighbors, bounds and
+    // errors. Called whenever the grids change.
+    void    Build(const std::vector<MountainGrid> &grids, int tile_level);
+
+    // Makes a tile of every block, as the blocks were measured when they
+    // were generated.
+    void    Build(const MountainBlocks &blocks);
+
+    // Works out the bounds and errors of a tile of grid.
+    static void	Measure(const MountainGrid &grid, MountainTile &tile);
+
+    // Decides which tiles are in view, and the coarsest detail for each that
+    // keeps its projected error within tolerance pixels, for the camera
+    // described by the column-major OpenGL modelview and projection matrices
+    // and the viewport.
+    void    Select(const float modelview[16], const float projection[16],
+		   const int viewport[4], float tolerance);
+
+    size_t		NumTiles(void) const { return tiles.size(); };
+    const MountainTile	&Tile(size_t t) const { return tiles[t]; };
+
+    // Makes the vertices of a tile at its current detail, stitched to its
+    // neighbors, and its triangles as one triangle strip. Triangles entirely
+    // on the ground are left out, and the pieces joined with degenerate
+    // triangles.
+    void    Extract(const std::vector<MountainGrid> &grids, size_t t,
+		    std::vector<MountainVertex> &vertices,
+		    std::vector<uint32_t> &strip) const;
+    void    Extract(const MountainBlocks &blocks, size_t t,
+		    std::vector<MountainVertex> &vertices,
+		    std::vector<uint32_t> &strip) const;
+};
+
+
+#endif
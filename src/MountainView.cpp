@@ -0,0 +1,91 @@
+/*
+ * MountainView.cpp: The camera as the mountain's level of detail sees it.
+ *
+ */
+
+
+#include "MountainView.h"
+#include <math.h>
+
+
+MountainView::MountainView(void)
+{
+    eye[0] = eye[1] = eye[2] = 0.0f;
+    for ( int i = 0 ; i < 6 ; i++ )
+	planes[i][0] = planes[i][1] = planes[i][2] = planes[i][3] = 0.0f;
+    pixel_scale = 1.0f;
+}
+
+
+void
+MountainView::Set(const float mv[16], const float proj[16], const int viewport[4])
+{
+    // The eye is the inverse modelview's translation: -R^T t.
+    for ( int i = 0 ; i < 3 ; i++ )
+	eye[i] = -( mv[i*4] * mv[12] + mv[i*4+1] * mv[13] + mv[i*4+2] * mv[14] );
+
+    // Frustum planes from the rows of projection * modelview.
+    float   m[16];
+    for ( int c = 0 ; c < 4 ; c++ )
+	for ( int r = 0 ; r < 4 ; r++ )
+	    m[c*4+r] = proj[r] * mv[c*4] + proj[4+r] * mv[c*4+1]
+		     + proj[8+r] * mv[c*4+2] + proj[12+r] * mv[c*4+3];
+    for ( int i = 0 ; i < 6 ; i++ )
+    {
+	int	row = i / 2;
+	float	sign = ( i % 2 ) ? -1.0f : 1.0f;
+	for ( int k = 0 ; k < 4 ; k++ )
+	    planes[i][k] = m[k*4+3] + sign * m[k*4+row];
+	float	len = sqrtf(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1]
+			    + planes[i][2] * planes[i][2]);
+	if ( len > 0.0f )
+	    for ( int k = 0 ; k < 4 ; k++ )
+		planes[i][k] /= len;
+    }
+
+    pixel_scale = viewport[3] * 0.5f * proj[5];
+}
+
+
+bool
+MountainView::SphereVisible(float cx, float cy, float cz, float radius) const
+{
+    for ( int i = 0 ; i < 6 ; i++ )
+	if ( planes[i][0] * cx + planes[i][1] * cy + planes[i][2] * cz
+	     + planes[i][3] < -radius )
+	    return false;
+    return true;
+}
+
+
+bool
+MountainView::BoxVisible(const float bounds[2][3]) const
+{
+    // Outside if the corner furthest along a plane's normal is behind it.
+    for ( int i = 0 ; i < 6 ; i++ )
+    {
+	float	d = planes[i][3];
+	for ( int k = 0 ; k < 3 ; k++ )
+	    d += planes[i][k] * bounds[planes[i][k] > 0.0f ? 1 : 0][k];
+	if ( d < 0.0f )
+	    return false;
+    }
+    return true;
+}
+
+
+float
+MountainView::BoxDistance(const float bounds[2][3]) const
+{
+    float   sum = 0.0f;
+    for ( int k = 0 ; k < 3 ; k++ )
+    {
+	float	d = 0.0f;
+	if ( eye[k] < bounds[0][k] )
+	    d = bounds[0][k] - eye[k];
+	else if ( eye[k] > bounds[1][k] )
+	    d = eye[k] - bounds[1][k];
+	sum += d * d;
+    }
+    return sqrtf(sum);
+}
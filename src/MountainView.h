@@ -0,0 +1,36 @@
+/*
+ * MountainView.h: Header file for the camera as the mountain's level of
+ * detail code sees it.
+ *
+ */
+
+
+#ifndef _MOUNTAINVIEW_H_
+#define _MOUNTAINVIEW_H_
+
+// Where the eye is, what it can see, and how big things look, taken from
+// the OpenGL matrices the mountain is about to be drawn with.
+struct MountainView {
+    float   eye[3];
+    float   planes[6][4];	// Frustum planes, normals pointing inwards.
+    float   pixel_scale;	// Pixels per unit of size at unit distance.
+
+    MountainView(void);
+
+    // Sets the view from the column-major OpenGL modelview and projection
+    // matrices and the viewport.
+    void    Set(const float modelview[16], const float projection[16],
+		const int viewport[4]);
+
+    // Whether any of a sphere, or of a box given as its low and high
+    // corners, is inside the frustum. Conservative: may say yes for
+    // something just outside a corner.
+    bool    SphereVisible(float cx, float cy, float cz, float radius) const;
+    bool    BoxVisible(const float bounds[2][3]) const;
+
+    // Distance from the eye to the nearest point of a box.
+    float   BoxDistance(const float bounds[2][3]) const;
+};
+
+
+#endif
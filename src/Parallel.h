@@ -0,0 +1,55 @@
+/*
+ * Parallel.h: Helpers for splitting work over worker threads.
+ *
+ */
+
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+// The number of threads work should be spread over. At least one.
+inline int
+NumThreads(void)
+{
+    static const int count = std::max(1, (int)std::thread::hardware_concurrency());
+    return count;
+}
+
+
+// Calls task(i) for every i in [0, num_tasks), spread over up to NumThreads()
+// threads including the caller. Tasks are handed out in order from a shared
+// counter, so many small tasks balance well. Returns once all are done.
+template <class Task>
+void
+ParallelFor(int num_tasks, const Task &task)
+{
+    int	threads = std::min(NumThreads(), num_tasks);
+
+    if ( threads <= 1 )
+    {
+	for ( int i = 0 ; i < num_tasks ; i++ )
+	    task(i);
+	return;
+    }
+
+    std::atomic<int>	next(0);
+    auto		worker = [&]() {
+	    for ( int i = next++ ; i < num_tasks ; i = next++ )
+		task(i);
+	};
+
+    std::vector<std::thread>	pool;
+    for ( int t = 1 ; t < threads ; t++ )
+	pool.push_back(std::thread(worker));
+    worker();
+    for ( size_t t = 0 ; t < pool.size() ; t++ )
+	pool[t].join();
+}
+
+
+#endif
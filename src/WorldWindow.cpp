@@ -88,7 +88,13 @@ WorldWindow::draw(void)
 	ground.Initialize();
 	traintrack.Initialize();
 	building.Initialize();
+	// The buildings shade the mountain, so it needs them before it
+	// builds or loads any level.
+	std::vector<float> occluders;
+	Building::Triangles(occluders);
+	mountain.SetOccluders(occluders);
     mountain.Initialize();
+    capture.Initialize();
     }
 
     // Stuff out here relies on a coordinate system or must be done on every
@@ -131,6 +137,9 @@ WorldWindow::draw(void)
     traintrack.Draw();
     building.Draw();
     mountain.Draw();
+
+    // Read back the finished frame if we are recording.
+    capture.Capture(w(), h());
 }
 
 
@@ -216,9 +225,34 @@ WorldWindow::handle(int event)
                     case 's':
                         mountain.Subdivide();
                         return 1;
+                    case 'u':
+                        mountain.Unsubdivide();
+                        return 1;
                     case 'r':
                         mountain.ResetSubdivision();
                         return 1;
+                    case 'n':
+                        mountain.SetSeed(mountain.Seed() + 1);
+                        mountain.ResetSubdivision();
+                        return 1;
+                    case 'l':
+                        mountain.SetLOD(!mountain.LOD());
+                        return 1;
+                    case 'd':
+                        mountain.SetDecimation(!mountain.Decimation());
+                        return 1;
+                    case 'g':
+                        mountain.SetGrid(!mountain.Grid());
+                        return 1;
+                    case 'm':
+                        mountain.SetNormalMap(!mountain.NormalMap());
+                        return 1;
+                    case 'c':
+                        if ( capture.Recording() )
+                            capture.Stop();
+                        else
+                            capture.Start("frame");
+                        return 1;
                 }
         }
     }
@@ -251,9 +285,34 @@ WorldWindow::handle(int event)
                     case 's':
                         mountain.Subdivide();
                         return 1;
+                    case 'u':
+                        mountain.Unsubdivide();
+                        return 1;
                     case 'r':
                         mountain.ResetSubdivision();
                         return 1;
+                    case 'n':
+                        mountain.SetSeed(mountain.Seed() + 1);
+                        mountain.ResetSubdivision();
+                        return 1;
+                    case 'l':
+                        mountain.SetLOD(!mountain.LOD());
+                        return 1;
+                    case 'd':
+                        mountain.SetDecimation(!mountain.Decimation());
+                        return 1;
+                    case 'g':
+                        mountain.SetGrid(!mountain.Grid());
+                        return 1;
+                    case 'm':
+                        mountain.SetNormalMap(!mountain.NormalMap());
+                        return 1;
+                    case 'c':
+                        if ( capture.Recording() )
+                            capture.Stop();
+                        else
+                            capture.Start("frame");
+                        return 1;
                 }
         }
     }
@@ -17,6 +17,7 @@
 #include "Track.h"
 #include "Building.h"
 #include "Mountain.h"
+#include "FrameCapture.h"
 
 
 // Subclass the Fl_Gl_Window because we want to draw OpenGL in here.
@@ -41,6 +42,7 @@ class WorldWindow : public Fl_Gl_Window {
 	Track  traintrack;	    // The train and track.
     Building building;      // The building object
     Mountain mountain;      // The building object
+    FrameCapture capture;   // Records frames to disk when toggled on
     
     bool viewTrack;
 
@@ -0,0 +1,322 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//      ImageResampler.cpp
+//
+//      Implementation of the separable image resampler.  The image is first
+//  filtered horizontally into a float buffer of dstWidth x srcHeight pixels,
+//  then vertically into the destination.  Each pass is split into bands of
+//  rows that run on their own threads, and the inner loops work on a whole
+//  RGBA pixel at a time with SSE2 when it is available.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ImageResampler.h"
+#include <math.h>
+#include <string.h>
+#include <thread>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RESAMPLER_SSE2
+#endif
+
+using namespace std;
+
+// constants
+const float PI                  = 3.14159265358979f;
+const int   MIN_WORK_PER_THREAD = 64 * 1024;            // samples a band must cover to justify a thread
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Constructor.  A thread count of 0 uses one thread per core.
+//
+///////////////////////////////////////////////////////////////////////////////
+ImageResampler::ImageResampler(Filter f, int threads) : filter(f), numThreads(threads)
+{}// ImageResampler
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Radius of the kernel at a scale of 1.
+//
+///////////////////////////////////////////////////////////////////////////////
+float ImageResampler::Support(void) const
+{
+    switch (filter)
+    {
+        case FILTER_BOX:        return 0.5f;
+        case FILTER_BILINEAR:   return 1.0f;
+        case FILTER_LANCZOS3:   return 3.0f;
+    }
+
+    return 1.0f;
+}// Support
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Evaluate the kernel at distance x, in source samples at a scale of 1.
+//
+///////////////////////////////////////////////////////////////////////////////
+float ImageResampler::Kernel(float x) const
+{
+    x = fabsf(x);
+
+    switch (filter)
+    {
+        case FILTER_BOX:
+            return x <= 0.5f ? 1.0f : 0.0f;
+
+        case FILTER_BILINEAR:
+            return x < 1.0f ? 1.0f - x : 0.0f;
+
+        case FILTER_LANCZOS3:
+            if (x < 1e-6f)
+                return 1.0f;
+            if (x >= 3.0f)
+                return 0.0f;
+            return 3.0f * sinf(PI * x) * sinf(PI * x / 3.0f) / (PI * PI * x * x);
+    }
+
+    return 0.0f;
+}// Kernel
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Build the tap list for resampling srcSize samples to dstSize samples.
+//  When minifying, the kernel is stretched by the reduction factor so every
+//  source sample contributes.  Weights are normalized to sum to one.
+//
+///////////////////////////////////////////////////////////////////////////////
+void ImageResampler::Compute_Contributions(int srcSize, int dstSize, vector<Contribution>& contribs,
+                                           vector<float>& weights) const
+{
+    float scale = (float)srcSize / (float)dstSize;
+    float filterScale = max(1.0f, scale);
+    float support = Support() * filterScale;
+
+    contribs.resize(dstSize);
+    weights.clear();
+
+    for (int i = 0; i < dstSize; i++)
+    {
+        float center = (i + 0.5f) * scale;
+        int left = (int)floorf(center - support);
+        int right = (int)ceilf(center + support);
+        int first = max(left, 0);
+        int last = min(right, srcSize - 1);
+        if (last < first)
+            first = last = min(max((int)center, 0), srcSize - 1);
+
+        Contribution& c = contribs[i];
+        c.first = first;
+        c.count = last - first + 1;
+        c.offset = (int)weights.size();
+        weights.resize(weights.size() + c.count, 0.0f);
+
+        float total = 0.0f;
+        for (int j = left; j <= right; j++)
+        {
+            float w = Kernel((j + 0.5f - center) / filterScale);
+            if (w == 0.0f)
+                continue;
+
+            // Clamp to the edge by folding the weight onto the border sample.
+            int k = min(max(j, first), last);
+            weights[c.offset + k - first] += w;
+            total += w;
+        }
+
+        if (total == 0.0f)
+        {
+            // The window fell between samples; take the closest one.
+            int k = min(max((int)center, first), last);
+            weights[c.offset + k - first] = 1.0f;
+            total = 1.0f;
+        }
+
+        for (int k = 0; k < c.count; k++)
+            weights[c.offset + k] /= total;
+    }
+}// Compute_Contributions
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Number of threads to use for a pass over the given number of rows that
+//  touches roughly work samples.  Small images stay on the calling thread.
+//
+///////////////////////////////////////////////////////////////////////////////
+int ImageResampler::Thread_Count(int rows, int work) const
+{
+    int threads = numThreads;
+    if (threads <= 0)
+        threads = (int)thread::hardware_concurrency();
+
+    threads = min(threads, work / MIN_WORK_PER_THREAD);
+    threads = min(threads, rows);
+
+    return max(threads, 1);
+}// Thread_Count
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Horizontal pass over source rows [rowBegin, rowEnd).  Writes float RGBA
+//  pixels into tmp, which is dstWidth pixels wide.
+//
+///////////////////////////////////////////////////////////////////////////////
+void ImageResampler::Horizontal_Rows(const unsigned char* src, int srcWidth, float* tmp, int dstWidth,
+                                     const Contribution* contribs, const float* weights,
+                                     int rowBegin, int rowEnd)
+{
+    for (int y = rowBegin; y < rowEnd; y++)
+    {
+        const unsigned char* in = src + (size_t)y * srcWidth * 4;
+        float* out = tmp + (size_t)y * dstWidth * 4;
+
+        for (int x = 0; x < dstWidth; x++)
+        {
+            const Contribution& c = contribs[x];
+            const unsigned char* p = in + c.first * 4;
+            const float* w = weights + c.offset;
+
+#ifdef RESAMPLER_SSE2
+            __m128i zero = _mm_setzero_si128();
+            __m128 acc = _mm_setzero_ps();
+            for (int k = 0; k < c.count; k++)
+            {
+                int packed;
+                memcpy(&packed, p + k * 4, 4);
+                __m128i px = _mm_cvtsi32_si128(packed);
+                px = _mm_unpacklo_epi16(_mm_unpacklo_epi8(px, zero), zero);
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_cvtepi32_ps(px), _mm_set1_ps(w[k])));
+            }
+            _mm_storeu_ps(out + x * 4, acc);
+#else
+            float r = 0, g = 0, b = 0, a = 0;
+            for (int k = 0; k < c.count; k++)
+            {
+                r += w[k] * p[k * 4];
+                g += w[k] * p[k * 4 + 1];
+                b += w[k] * p[k * 4 + 2];
+                a += w[k] * p[k * 4 + 3];
+            }
+            out[x * 4] = r;
+            out[x * 4 + 1] = g;
+            out[x * 4 + 2] = b;
+            out[x * 4 + 3] = a;
+#endif
+        }
+    }
+}// Horizontal_Rows
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Vertical pass producing destination rows [rowBegin, rowEnd).  Each tap
+//  adds a whole row of tmp, so memory is read sequentially.
+//
+///////////////////////////////////////////////////////////////////////////////
+void ImageResampler::Vertical_Rows(const float* tmp, int dstWidth, unsigned char* dst,
+                                   const Contribution* contribs, const float* weights,
+                                   int rowBegin, int rowEnd)
+{
+    int rowFloats = dstWidth * 4;
+    vector<float> acc(rowFloats);
+
+    for (int y = rowBegin; y < rowEnd; y++)
+    {
+        const Contribution& c = contribs[y];
+        const float* w = weights + c.offset;
+        unsigned char* out = dst + (size_t)y * rowFloats;
+
+        fill(acc.begin(), acc.end(), 0.0f);
+        for (int k = 0; k < c.count; k++)
+        {
+            const float* in = tmp + (size_t)(c.first + k) * rowFloats;
+            int i = 0;
+#ifdef RESAMPLER_SSE2
+            __m128 wk = _mm_set1_ps(w[k]);
+            for (; i + 4 <= rowFloats; i += 4)
+                _mm_storeu_ps(&acc[i], _mm_add_ps(_mm_loadu_ps(&acc[i]), _mm_mul_ps(_mm_loadu_ps(in + i), wk)));
+#endif
+            for (; i < rowFloats; i++)
+                acc[i] += w[k] * in[i];
+        }
+
+        int i = 0;
+#ifdef RESAMPLER_SSE2
+        // Round, then saturate to [0, 255] while packing down to bytes.
+        for (; i + 4 <= rowFloats; i += 4)
+        {
+            __m128i v = _mm_cvtps_epi32(_mm_loadu_ps(&acc[i]));
+            v = _mm_packus_epi16(_mm_packs_epi32(v, v), v);
+            int packed = _mm_cvtsi128_si32(v);
+            memcpy(out + i, &packed, 4);
+        }
+#endif
+        for (; i < rowFloats; i++)
+        {
+            float v = floorf(acc[i] + 0.5f);
+            out[i] = (unsigned char)min(max(v, 0.0f), 255.0f);
+        }
+    }
+}// Vertical_Rows
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Resample src into dst.  Both are tightly packed RGBA, 4 bytes a pixel.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool ImageResampler::Resample(const unsigned char* src, int srcWidth, int srcHeight,
+                              unsigned char* dst, int dstWidth, int dstHeight) const
+{
+    if (!src || !dst || srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0)
+        return false;
+
+    vector<Contribution> hContribs, vContribs;
+    vector<float> hWeights, vWeights;
+    Compute_Contributions(srcWidth, dstWidth, hContribs, hWeights);
+    Compute_Contributions(srcHeight, dstHeight, vContribs, vWeights);
+
+    vector<float> tmp((size_t)dstWidth * srcHeight * 4);
+    vector<thread> workers;
+
+    // horizontal pass, banded over source rows
+    int threads = Thread_Count(srcHeight, dstWidth * srcHeight);
+    for (int t = 0; t < threads; t++)
+    {
+        int rowBegin = (int)((long long)srcHeight * t / threads);
+        int rowEnd = (int)((long long)srcHeight * (t + 1) / threads);
+        if (t == threads - 1)
+            Horizontal_Rows(src, srcWidth, &tmp[0], dstWidth, &hContribs[0], &hWeights[0], rowBegin, rowEnd);
+        else
+            workers.push_back(thread(Horizontal_Rows, src, srcWidth, &tmp[0], dstWidth,
+                                     &hContribs[0], &hWeights[0], rowBegin, rowEnd));
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    workers.clear();
+
+    // vertical pass, banded over destination rows
+    threads = Thread_Count(dstHeight, dstWidth * dstHeight);
+    for (int t = 0; t < threads; t++)
+    {
+        int rowBegin = (int)((long long)dstHeight * t / threads);
+        int rowEnd = (int)((long long)dstHeight * (t + 1) / threads);
+        if (t == threads - 1)
+            Vertical_Rows(&tmp[0], dstWidth, dst, &vContribs[0], &vWeights[0], rowBegin, rowEnd);
+        else
+            workers.push_back(thread(Vertical_Rows, &tmp[0], dstWidth, dst,
+                                     &vContribs[0], &vWeights[0], rowBegin, rowEnd));
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+
+    return true;
+}// Resample
@@ -0,0 +1,64 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//      ImageResampler.h
+//
+//      Separable, multithreaded resampler for 8-bit RGBA images. Does not
+//  touch OpenGL, so it can be used before a context exists or offline.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef IMAGE_RESAMPLER_H_
+#define IMAGE_RESAMPLER_H_
+
+#include <vector>
+
+class ImageResampler
+{
+    // types
+    public:
+        enum Filter
+        {
+            FILTER_BOX,                             // nearest-area box filter
+            FILTER_BILINEAR,                        // tent filter, widened when minifying
+            FILTER_LANCZOS3                         // windowed sinc with three lobes
+        };
+
+    // methods
+    public:
+        ImageResampler(Filter filter = FILTER_LANCZOS3, int numThreads = 0);
+
+        // Resample an RGBA image of srcWidth x srcHeight into dst, which must
+        // hold dstWidth * dstHeight * 4 bytes.  Returns false on bad arguments.
+        bool Resample(const unsigned char* src, int srcWidth, int srcHeight,
+                      unsigned char* dst, int dstWidth, int dstHeight) const;
+
+        Filter  filter;                             // kernel used by Resample
+        int     numThreads;                         // worker count, 0 means one per core
+
+    private:
+        // The taps for one output sample along one axis.  Weights for source
+        // samples outside the image are folded onto the edge sample, so every
+        // tap reads a contiguous, in-range window.
+        struct Contribution
+        {
+            int first;                              // first source index
+            int count;                              // number of taps
+            int offset;                             // start of the weights in the weight table
+        };
+
+        float Support(void) const;
+        float Kernel(float x) const;
+        void  Compute_Contributions(int srcSize, int dstSize, std::vector<Contribution>& contribs,
+                                    std::vector<float>& weights) const;
+        int   Thread_Count(int rows, int work) const;
+
+        static void Horizontal_Rows(const unsigned char* src, int srcWidth, float* tmp, int dstWidth,
+                                    const Contribution* contribs, const float* weights,
+                                    int rowBegin, int rowEnd);
+        static void Vertical_Rows(const float* tmp, int dstWidth, unsigned char* dst,
+                                  const Contribution* contribs, const float* weights,
+                                  int rowBegin, int rowEnd);
+};
+
+
+#endif
@@ -0,0 +1,231 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//      ImageResamplerTest.cpp
+//
+//      Headless checks of ImageResampler against known outputs: identity and
+//  constant images for every filter, hand-worked downscales for the box and
+//  bilinear filters, and a straightforward double precision reference for
+//  all three.  Exits with the number of failed checks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ImageResampler.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+// constants
+const double    PI          = 3.14159265358979;
+const char*     FILTER_NAMES[] = { "box", "bilinear", "lanczos3" };
+
+static int failures = 0;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Record a failed check.
+//
+///////////////////////////////////////////////////////////////////////////////
+static void Check(bool ok, const char* what, ImageResampler::Filter filter)
+{
+    if (!ok)
+    {
+        printf("FAIL %s (%s)\n", what, FILTER_NAMES[filter]);
+        failures++;
+    }// if
+}// Check
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      The filter kernels, as documented in ImageResampler.
+//
+///////////////////////////////////////////////////////////////////////////////
+static double Reference_Kernel(ImageResampler::Filter filter, double x)
+{
+    x = fabs(x);
+    switch (filter)
+    {
+        case ImageResampler::FILTER_BOX:
+            return x <= 0.5 ? 1.0 : 0.0;
+        case ImageResampler::FILTER_BILINEAR:
+            return x < 1.0 ? 1.0 - x : 0.0;
+        case ImageResampler::FILTER_LANCZOS3:
+            if (x < 1e-9)
+                return 1.0;
+            return x < 3.0 ? 3.0 * sin(PI * x) * sin(PI * x / 3.0) / (PI * PI * x * x) : 0.0;
+    }
+
+    return 0.0;
+}// Reference_Kernel
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Resample one axis the slow way: every output sample sums the kernel
+//  over the whole widened window, clamping reads to the edge, and divides by
+//  the total weight.
+//
+///////////////////////////////////////////////////////////////////////////////
+static void Reference_Axis(ImageResampler::Filter filter, const vector<double>& src, int srcSize,
+                           int count, vector<double>& dst, int dstSize)
+{
+    double scale = (double)srcSize / dstSize;
+    double filterScale = max(1.0, scale);
+    double support = (filter == ImageResampler::FILTER_BOX ? 0.5 :
+                      filter == ImageResampler::FILTER_BILINEAR ? 1.0 : 3.0) * filterScale;
+
+    for (int line = 0; line < count; line++)
+        for (int i = 0; i < dstSize; i++)
+        {
+            double center = (i + 0.5) * scale;
+            double sum = 0.0, total = 0.0;
+            for (int j = (int)floor(center - support); j <= (int)ceil(center + support); j++)
+            {
+                double w = Reference_Kernel(filter, (j + 0.5 - center) / filterScale);
+                int k = min(max(j, 0), srcSize - 1);
+                sum += w * src[(size_t)line * srcSize + k];
+                total += w;
+            }
+            dst[(size_t)line * dstSize + i] = sum / total;
+        }
+}// Reference_Axis
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Compare the resampler against the reference on a random image, allowing
+//  one level of rounding difference per channel.
+//
+///////////////////////////////////////////////////////////////////////////////
+static void Check_Reference(ImageResampler::Filter filter, int srcWidth, int srcHeight,
+                            int dstWidth, int dstHeight)
+{
+    vector<unsigned char> src((size_t)srcWidth * srcHeight * 4);
+    for (size_t i = 0; i < src.size(); i++)
+        src[i] = (unsigned char)(rand() & 255);
+
+    // horizontally, on each channel of each row, then vertically
+    vector<double> in(src.begin(), src.end());
+    vector<double> out((size_t)dstWidth * dstHeight * 4);
+    for (int c = 0; c < 4; c++)
+    {
+        vector<double> plane((size_t)srcWidth * srcHeight), rows((size_t)dstWidth * srcHeight);
+        for (size_t i = 0; i < plane.size(); i++)
+            plane[i] = in[i * 4 + c];
+        Reference_Axis(filter, plane, srcWidth, srcHeight, rows, dstWidth);
+
+        // transpose, so the columns are lines
+        vector<double> cols(rows.size()), result((size_t)dstWidth * dstHeight);
+        for (int y = 0; y < srcHeight; y++)
+            for (int x = 0; x < dstWidth; x++)
+                cols[(size_t)x * srcHeight + y] = rows[(size_t)y * dstWidth + x];
+        Reference_Axis(filter, cols, srcHeight, dstWidth, result, dstHeight);
+        for (int x = 0; x < dstWidth; x++)
+            for (int y = 0; y < dstHeight; y++)
+                out[((size_t)y * dstWidth + x) * 4 + c] = result[(size_t)x * dstHeight + y];
+    }// for
+
+    vector<unsigned char> dst((size_t)dstWidth * dstHeight * 4);
+    ImageResampler resampler(filter);
+    Check(resampler.Resample(&src[0], srcWidth, srcHeight, &dst[0], dstWidth, dstHeight),
+          "reference resample", filter);
+
+    int worst = 0;
+    for (size_t i = 0; i < dst.size(); i++)
+    {
+        double expected = min(max(floor(out[i] + 0.5), 0.0), 255.0);
+        worst = max(worst, (int)fabs(dst[i] - expected));
+    }// for
+    Check(worst <= 1, "matches the reference", filter);
+}// Check_Reference
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//      Resample a single row of gray pixels and compare to known values.
+//
+///////////////////////////////////////////////////////////////////////////////
+static void Check_Row(ImageResampler::Filter filter, const vector<int>& in,
+                      const vector<int>& expected, const char* what)
+{
+    vector<unsigned char> src(in.size() * 4), dst(expected.size() * 4);
+    for (size_t i = 0; i < in.size(); i++)
+        fill(&src[i * 4], &src[i * 4] + 4, (unsigned char)in[i]);
+
+    ImageResampler resampler(filter);
+    bool ok = resampler.Resample(&src[0], (int)in.size(), 1, &dst[0], (int)expected.size(), 1);
+    for (size_t i = 0; ok && i < dst.size(); i++)
+        ok = dst[i] == expected[i / 4];
+    Check(ok, what, filter);
+}// Check_Row
+
+
+int main(void)
+{
+    ImageResampler::Filter filters[] = { ImageResampler::FILTER_BOX, ImageResampler::FILTER_BILINEAR,
+                                         ImageResampler::FILTER_LANCZOS3 };
+    srand(1);
+
+    for (int f = 0; f < 3; f++)
+    {
+        ImageResampler::Filter filter = filters[f];
+        ImageResampler resampler(filter);
+
+        // the same size gives back the same image
+        int w = 53, h = 31;
+        vector<unsigned char> src((size_t)w * h * 4), dst(src.size());
+        for (size_t i = 0; i < src.size(); i++)
+            src[i] = (unsigned char)(rand() & 255);
+        Check(resampler.Resample(&src[0], w, h, &dst[0], w, h) && dst == src, "identity", filter);
+
+        // a constant image stays constant at any size, ringing or not
+        int sizes[][4] = { { 40, 30, 13, 7 }, { 13, 7, 64, 64 }, { 100, 1, 1, 1 } };
+        for (int s = 0; s < 3; s++)
+        {
+            vector<unsigned char> flat((size_t)sizes[s][0] * sizes[s][1] * 4), out((size_t)sizes[s][2] * sizes[s][3] * 4);
+            for (size_t i = 0; i < flat.size(); i++)
+                flat[i] = (unsigned char)(i % 4 * 60 + 17);
+            bool ok = resampler.Resample(&flat[0], sizes[s][0], sizes[s][1], &out[0], sizes[s][2], sizes[s][3]);
+            for (size_t i = 0; ok && i < out.size(); i++)
+                ok = out[i] == i % 4 * 60 + 17;
+            Check(ok, "constant", filter);
+        }// for
+
+        // a band split over many threads gives the same bytes as one
+        vector<unsigned char> big((size_t)512 * 512 * 4), one((size_t)300 * 200 * 4), many(one.size());
+        for (size_t i = 0; i < big.size(); i++)
+            big[i] = (unsigned char)(rand() & 255);
+        ImageResampler single(filter, 1), threaded(filter, 8);
+        single.Resample(&big[0], 512, 512, &one[0], 300, 200);
+        threaded.Resample(&big[0], 512, 512, &many[0], 300, 200);
+        Check(one == many, "threads agree", filter);
+
+        Check_Reference(filter, 37, 29, 16, 11);
+        Check_Reference(filter, 16, 11, 37, 29);
+    }// for
+
+    // Halving averages pairs with the box, and weighs in a quarter of each
+    // neighbor with the tent, whose outer tap folds onto the edge pixel.
+    int in[] = { 0, 80, 160, 240 };
+    vector<int> row(in, in + 4);
+    int box[] = { 40, 200 };
+    int tent[] = { 50, 190 };
+    Check_Row(ImageResampler::FILTER_BOX, row, vector<int>(box, box + 2), "box downscale");
+    Check_Row(ImageResampler::FILTER_BILINEAR, row, vector<int>(tent, tent + 2), "bilinear downscale");
+
+    // bad arguments are refused
+    unsigned char pixel[4] = { 0 };
+    ImageResampler resampler;
+    Check(!resampler.Resample(pixel, 0, 1, pixel, 1, 1), "bad size refused", resampler.filter);
+    Check(!resampler.Resample(NULL, 1, 1, pixel, 1, 1), "null refused", resampler.filter);
+
+    if (!failures)
+        printf("all passed\n");
+
+    return failures;
+}// main
@@ -1,4 +1,5 @@
 #include "MyWindow.h"
+#include "ImageResampler.h"
 #include <Fl/Gl.h>
 #include <Fl/Fl.h>
 #include <OpenGl/Glu.h>
@@ -190,21 +191,22 @@ void MyWindow::LoadTexture(char* filename)
 bool MyWindow::ResizeImage(TargaImage* image)
 {
     int newWidth = pow(2.0, (int)ceil(log((float)image->width) / log(2.f)));
-    int newHeight = pow(2.0, (int)ceil(log((float)image->width) / log(2.f)));
+    int newHeight = pow(2.0, (int)ceil(log((float)image->height) / log(2.f)));
 
     newWidth = fmax(64, newWidth);
     newHeight = fmax(64, newHeight);
 
-    if (newWidth != image->width && newHeight != image->height)
+    if (newWidth != image->width || newHeight != image->height)
     {
         unsigned char* scaledData = new unsigned char[newWidth * newHeight * 4];
-        if (gluScaleImage(GL_RGBA, image->width, image->height, GL_UNSIGNED_BYTE, image->data, newWidth, newHeight, GL_UNSIGNED_BYTE, scaledData) != 0)
+        ImageResampler resampler(ImageResampler::FILTER_LANCZOS3);
+        if (!resampler.Resample(image->data, image->width, image->height, scaledData, newWidth, newHeight))
         {
             delete[] scaledData;
             return false;
         }// if
 
-        delete image->data;
+        delete[] image->data;
         image->data = scaledData;
         image->width = newWidth;
         image->height = newHeight;